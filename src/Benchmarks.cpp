@@ -0,0 +1,337 @@
+// Microbenchmarks of the hot-path kernels of the capture→inference pipeline.
+//
+//   make bench && ./my_benchmarks [--benchmark_filter=...] [model.tflite]
+//
+// Every benchmark reports bytes/s (input bytes) and, when the kernel exposes
+// CPU cycles through perf_event_open, cycles per processed pixel.
+// Optimized kernels get their benchmark here, next to the baseline they replace.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef WITH_OPENCV
+#include <opencv2/opencv.hpp>  // baselines the in-house kernels are compared to
+#endif
+
+#include "Kernels.h"
+#include "ModelInterpreter.h"
+#include "PerfCounters.h"
+#include "WorkerPool.h"
+
+static std::string model_file = "../models/my_model.tflite";
+static std::string label_file = "../models/labels.txt";
+
+// Runs the benchmark loop body, then sets the bytes/s and cycles/px counters
+template <typename F>
+static void measure (benchmark::State &state, size_t bytes, size_t pixels, F &&body)
+{
+	// Cycles of the calling thread only: interpreter worker threads are not included
+	PerfCounters counters;
+	uint64_t start = counters.read()[PerfCounters::Cycles];
+	for (auto _ : state)
+		body();
+	uint64_t spent = counters.read()[PerfCounters::Cycles] - start;
+
+	state.SetBytesProcessed(int64_t(state.iterations()) * bytes);
+	state.counters["px/s"] = benchmark::Counter(double(state.iterations()) * pixels, benchmark::Counter::kIsRate);
+	if (counters.available(PerfCounters::Cycles))
+		state.counters["cycles/px"] = double(spent) / (double(state.iterations()) * pixels);
+}
+
+// Synthetic NV12 frame with some texture, so that nothing is trivially predictable
+static std::vector<uint8_t> makeNV12 (int width, int height)
+{
+	std::vector<uint8_t> nv12(width * (height + height / 2));
+	for (int y = 0; y < height + height / 2; ++y)
+		for (int x = 0; x < width; ++x)
+			nv12[y * width + x] = uint8_t(x * 7 + y * 13 + (x * y >> 5));
+	return nv12;
+}
+
+static std::vector<uint8_t> makeBGR (int width, int height)
+{
+	std::vector<uint8_t> bgr(width * height * 3);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width * 3; ++x)
+			bgr[y * width * 3 + x] = uint8_t(x * 5 + y * 11 + (x * y >> 6));
+	return bgr;
+}
+
+// Synthetic raw Bayer frame (10-bit): one uint16 per pixel, or CSI-2 packed; returns the stride
+static std::vector<uint8_t> makeBayer (int width, int height, bool packed, int &stride)
+{
+	stride = packed ? width * 5 / 4 : width * 2;
+	std::vector<uint8_t> raw(stride * height);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x) {
+			uint16_t level = uint16_t((x * 7 + y * 13 + (x * y >> 5)) & 1023);
+			if (!packed) {
+				reinterpret_cast<uint16_t*>(&raw[y * stride])[x] = level;
+			} else {
+				raw[y * stride + x / 4 * 5 + x % 4] = uint8_t(level >> 2);
+				raw[y * stride + x / 4 * 5 + 4] |= uint8_t((level & 3) << 2 * (x % 4));
+			}
+		}
+	return raw;
+}
+
+// Camera resolutions: {width, height}
+static void cameraSizes (benchmark::internal::Benchmark *b)
+{
+	b->Args({320, 240})->Args({640, 480})->Args({1280, 720})->Args({1920, 1080});
+}
+
+// Camera resolutions × model input sizes: {width, height, model side}
+static void cameraAndModelSizes (benchmark::internal::Benchmark *b)
+{
+	for (int side : {96, 128, 160, 224}) {
+		b->Args({640, 480, side});
+		b->Args({1280, 720, side});
+	}
+	b->Args({320, 240, 224})->Args({1920, 1080, 224});
+}
+
+// Model input sizes: {model side}
+static void modelSizes (benchmark::internal::Benchmark *b)
+{
+	for (int side : {96, 128, 160, 224})
+		b->Args({side});
+}
+
+// --- CameraHandler::requestComplete ---
+
+static void BM_FrameCopy (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1);
+	std::vector<uint8_t> nv12 = makeNV12(width, height), data;
+	measure(state, nv12.size(), width * height, [&] {
+		data.assign(nv12.begin(), nv12.end());
+		benchmark::DoNotOptimize(data.data());
+	});
+}
+BENCHMARK(BM_FrameCopy)->Apply(cameraSizes);
+
+// Staged capture reads (cached source here: see CameraHandler's startup measurement for dma-bufs)
+static void BM_StreamCopy (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1);
+	std::vector<uint8_t> nv12 = makeNV12(width, height), data(nv12.size());
+	measure(state, nv12.size(), width * height, [&] {
+		streamCopy(nv12.data(), data.data(), nv12.size());
+		benchmark::DoNotOptimize(data.data());
+	});
+}
+BENCHMARK(BM_StreamCopy)->Apply(cameraSizes);
+
+// --- FramePipeline::preprocess ---
+
+static void BM_NV12ToRGBResize (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1), side = state.range(2);
+	std::vector<uint8_t> nv12 = makeNV12(width, height), rgb(side * side * 3);
+	ResizeMap map;
+	makeResizeMap(map, width, height, side, side);
+	measure(state, nv12.size(), side * side, [&] {
+		nv12ToRGBResize(nv12.data(), nv12.data() + width * height, width, rgb.data(), map);
+		benchmark::DoNotOptimize(rgb.data());
+	});
+}
+BENCHMARK(BM_NV12ToRGBResize)->Apply(cameraAndModelSizes);
+
+// Same, split into bands of output rows across cores: {width, height, model side, cores}
+static void BM_NV12ToRGBResize_Bands (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1), side = state.range(2), cores = state.range(3);
+	std::vector<uint8_t> nv12 = makeNV12(width, height), rgb(side * side * 3);
+	ResizeMap map;
+	makeResizeMap(map, width, height, side, side);
+	WorkerPool workers(cores - 1);
+	const int bands = std::min<int>(side, 2 * workers.concurrency());
+	measure(state, nv12.size(), side * side, [&] {
+		workers.parallelFor(bands, [&] (int b) {
+			nv12ToRGBResize(nv12.data(), nv12.data() + width * height, width, rgb.data(), map, side * b / bands, side * (b + 1) / bands);
+		});
+		benchmark::DoNotOptimize(rgb.data());
+	});
+}
+BENCHMARK(BM_NV12ToRGBResize_Bands)
+	->ArgsProduct({{640}, {480}, {224}, {1, 2, 3, 4}})
+	->ArgsProduct({{1920}, {1080}, {224}, {1, 2, 3, 4}})
+	->UseRealTime();
+
+static void BM_BGRToRGBResize (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1), side = state.range(2);
+	std::vector<uint8_t> bgr = makeBGR(width, height), rgb(side * side * 3);
+	ResizeMap map;
+	makeResizeMap(map, width, height, side, side);
+	measure(state, bgr.size(), side * side, [&] {
+		bgrToRGBResize(bgr.data(), width * 3, rgb.data(), map);
+		benchmark::DoNotOptimize(rgb.data());
+	});
+}
+BENCHMARK(BM_BGRToRGBResize)->Apply(cameraAndModelSizes);
+
+// Raw capture: demosaic by binning, {width, height, bin, packed}
+static void BM_BayerToRGBBinned (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1), bin = state.range(2), stride;
+	const FrameFormat format = state.range(3) ? FrameFormat::Bayer10P : FrameFormat::Bayer16;
+	std::vector<uint8_t> raw = makeBayer(width, height, state.range(3), stride), rgb((width / bin) * (height / bin) * 3);
+	RawToneMap tone_map;
+	makeRawToneMap(tone_map, RawInfo());
+	measure(state, raw.size(), width * height, [&] {
+		bayerToRGBBinned(raw.data(), format, width, stride, bin, tone_map, rgb.data(), 0, height / bin);
+		benchmark::DoNotOptimize(rgb.data());
+	});
+}
+BENCHMARK(BM_BayerToRGBBinned)
+	->ArgsProduct({{640}, {480}, {2, 4}, {0, 1}})
+	->ArgsProduct({{1640}, {1232}, {2, 4}, {0, 1}});
+
+// Raw capture all the way to the model input, as FramePipeline does it: {width, height, model side}
+static void BM_BayerToRGBResize (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1), side = state.range(2), stride;
+	std::vector<uint8_t> raw = makeBayer(width, height, true, stride), rgb(side * side * 3);
+	const int bin = width / 4 >= side && height / 4 >= side ? 4 : 2;
+	std::vector<uint8_t> binned((width / bin) * (height / bin) * 3);
+	RawToneMap tone_map;
+	makeRawToneMap(tone_map, RawInfo());
+	ResizeMap map;
+	makeResizeMap(map, width / bin, height / bin, side, side);
+	measure(state, raw.size(), side * side, [&] {
+		bayerToRGBBinned(raw.data(), FrameFormat::Bayer10P, width, stride, bin, tone_map, binned.data(), 0, height / bin);
+		rgbResize(binned.data(), (width / bin) * 3, rgb.data(), map);
+		benchmark::DoNotOptimize(rgb.data());
+	});
+}
+BENCHMARK(BM_BayerToRGBResize)->Apply(cameraAndModelSizes);
+
+#ifdef WITH_OPENCV
+// Former preprocessing: full-resolution conversion, then resize, then channel swap
+static void BM_NV12ToRGBResize_OpenCV (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1), side = state.range(2);
+	std::vector<uint8_t> data = makeNV12(width, height);
+	cv::Mat nv12(height + height / 2, width, CV_8UC1, data.data()), bgr, resized;
+	measure(state, data.size(), side * side, [&] {
+		cv::cvtColor(nv12, bgr, cv::COLOR_YUV2BGR_NV12);
+		cv::resize(bgr, resized, cv::Size(side, side));
+		cv::cvtColor(resized, resized, cv::COLOR_BGR2RGB);
+		benchmark::DoNotOptimize(resized.data);
+	});
+
+	// Largest difference with the in-house kernel, on any channel
+	std::vector<uint8_t> rgb(side * side * 3);
+	ResizeMap map;
+	makeResizeMap(map, width, height, side, side);
+	nv12ToRGBResize(data.data(), data.data() + width * height, width, rgb.data(), map);
+	int max_diff = 0;
+	for (size_t i = 0; i < rgb.size(); ++i)
+		max_diff = std::max(max_diff, std::abs(int(rgb[i]) - int(resized.data[i])));
+	state.counters["max_diff"] = max_diff;
+}
+BENCHMARK(BM_NV12ToRGBResize_OpenCV)->Apply(cameraAndModelSizes);
+
+static void BM_NV12ToBGR_OpenCV (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1);
+	std::vector<uint8_t> data = makeNV12(width, height);
+	cv::Mat nv12(height + height / 2, width, CV_8UC1, data.data()), bgr;
+	measure(state, data.size(), width * height, [&] {
+		cv::cvtColor(nv12, bgr, cv::COLOR_YUV2BGR_NV12);
+		benchmark::DoNotOptimize(bgr.data);
+	});
+}
+BENCHMARK(BM_NV12ToBGR_OpenCV)->Apply(cameraSizes);
+
+static void BM_Resize_OpenCV (benchmark::State &state)
+{
+	int width = state.range(0), height = state.range(1), side = state.range(2);
+	std::vector<uint8_t> data = makeBGR(width, height);
+	cv::Mat bgr(height, width, CV_8UC3, data.data()), resized;
+	measure(state, data.size(), side * side, [&] {
+		cv::resize(bgr, resized, cv::Size(side, side));
+		benchmark::DoNotOptimize(resized.data);
+	});
+}
+BENCHMARK(BM_Resize_OpenCV)->Apply(cameraAndModelSizes);
+#endif // WITH_OPENCV
+
+// --- ModelInterpreter::runInference ---
+
+static void BM_InputCopyU8 (benchmark::State &state)
+{
+	int side = state.range(0);
+	size_t count = side * side * 3;
+	std::vector<uint8_t> src(count, 17), dst(count);
+	measure(state, count, side * side, [&] {
+		std::memcpy(dst.data(), src.data(), count);
+		benchmark::DoNotOptimize(dst.data());
+	});
+}
+BENCHMARK(BM_InputCopyU8)->Apply(modelSizes);
+
+static void BM_InputConvertU8ToF32 (benchmark::State &state)
+{
+	int side = state.range(0);
+	size_t count = side * side * 3;
+	std::vector<uint8_t> src(count, 17);
+	std::vector<float> dst(count);
+	measure(state, count, side * side, [&] {
+		convertInputU8ToF32(src.data(), dst.data(), count);
+		benchmark::DoNotOptimize(dst.data());
+	});
+}
+BENCHMARK(BM_InputConvertU8ToF32)->Apply(modelSizes);
+
+static void BM_OutputDequantizeU8 (benchmark::State &state)
+{
+	size_t count = state.range(0);
+	std::vector<uint8_t> src(count, 200);
+	std::vector<float> dst(count);
+	measure(state, count, count, [&] {
+		dequantizeU8(src.data(), dst.data(), count, 1.f / 256, 0);
+		benchmark::DoNotOptimize(dst.data());
+	});
+}
+BENCHMARK(BM_OutputDequantizeU8)->Arg(4)->Arg(1000);
+
+static void BM_Invoke (benchmark::State &state)
+{
+	ModelOptions options;
+	options.model_file = model_file;
+	options.label_file = label_file;
+	options.num_threads = state.range(0);
+
+	ModelInterpreter interpreter;
+	if (!interpreter.init(options)) {
+		state.SkipWithError("Failed to load the model");
+		return;
+	}
+	int width = interpreter.getInputWidth(), height = interpreter.getInputHeight();
+	std::vector<uint8_t> input = makeBGR(width, height);
+	interpreter.runInference(input.data()); // warm-up
+
+	measure(state, input.size(), width * height, [&] {
+		benchmark::DoNotOptimize(interpreter.runInference(input.data()));
+	});
+}
+BENCHMARK(BM_Invoke)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+int main (int argc, char **argv)
+{
+	benchmark::Initialize(&argc, argv);
+	// Remaining arguments: [model.tflite [labels.txt]]
+	if (argc > 1) model_file = argv[1];
+	if (argc > 2) label_file = argv[2];
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,33 @@
+#include "BufferPool.h"
+
+BufferPool::BufferPool (size_t buffer_size) :
+	buffer_size_(buffer_size),
+	free_(std::make_shared<FreeList>())
+{
+}
+
+std::shared_ptr<LockedBuffer> BufferPool::acquire ()
+{
+	std::unique_ptr<LockedBuffer> buffer;
+	{
+		std::lock_guard<std::mutex> lock(free_->mutex);
+		if (!free_->buffers.empty()) {
+			buffer = std::move(free_->buffers.back());
+			free_->buffers.pop_back();
+		}
+	}
+	if (!buffer) {
+		buffer = std::make_unique<LockedBuffer>(buffer_size_);
+		if (!*buffer) return nullptr;
+	}
+
+	std::weak_ptr<FreeList> pool = free_;
+	return std::shared_ptr<LockedBuffer>(buffer.release(), [pool] (LockedBuffer *released) {
+		if (std::shared_ptr<FreeList> list = pool.lock()) {
+			std::lock_guard<std::mutex> lock(list->mutex);
+			list->buffers.emplace_back(released);
+		} else {
+			delete released;
+		}
+	});
+}
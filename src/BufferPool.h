@@ -0,0 +1,30 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "LockedMemory.h"
+
+// Recycles fixed-size LockedBuffers (page aligned, pre-faulted). Buffers go back to the pool
+// when their last reference is dropped, even after the pool is gone. Thread-safe.
+class BufferPool
+{
+public:
+	explicit BufferPool (size_t buffer_size);
+
+	std::shared_ptr<LockedBuffer> acquire (); // null if the allocation failed
+	size_t bufferSize () const { return buffer_size_; }
+
+private:
+	struct FreeList
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<LockedBuffer>> buffers;
+	};
+	size_t const buffer_size_;
+	std::shared_ptr<FreeList> free_;
+};
+
+#endif // BUFFER_POOL_H
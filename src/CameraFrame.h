@@ -0,0 +1,62 @@
+#ifndef CAMERA_FRAME_H
+#define CAMERA_FRAME_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "LockedMemory.h"
+
+// Pixel layouts a CameraFrame can carry
+enum class FrameFormat {
+	NV12, // Y plane followed by the interleaved UV plane, both with the same stride
+	BGR,  // packed 8-bit BGR (e.g. decoded MJPEG)
+	// Raw sensor mosaic, straight from the sensor without ISP processing (see RawInfo)
+	Bayer16,  // one little-endian uint16 per pixel, bit_depth significant bits
+	Bayer10P, // MIPI CSI-2 packed 10-bit: 4 pixels in 5 bytes (high bytes, then the low bits)
+};
+
+inline bool isBayer (FrameFormat format) {return format == FrameFormat::Bayer16 || format == FrameFormat::Bayer10P;}
+
+// Colors of the top row of the 2×2 Bayer pattern, from the top-left pixel
+enum class BayerOrder {RGGB, GRBG, GBRG, BGGR};
+
+// What raw frames need from the ISP stages they skip: pattern, levels and white balance
+struct RawInfo {
+	BayerOrder order       = BayerOrder::RGGB;
+	int        bit_depth   = 10;
+	int        black_level = 64;             // in bit_depth units
+	float      gains[3]    = {1.6f, 1.f, 1.8f}; // R, G, B white balance (typical daylight)
+};
+
+// Non-owning view of a frame, for pixels that don't live in a CameraFrame (e.g. Python arrays)
+struct FrameView {
+	const uint8_t *data;
+	FrameFormat format;
+	int width;
+	int height;
+	int stride;
+	uint32_t sequence;
+	RawInfo raw; // Bayer formats only
+};
+
+// Structure for an acquired frame. Frames handed out by a FramePool can be retained past
+// the frame callback with shared_from_this().
+struct CameraFrame : std::enable_shared_from_this<CameraFrame> {
+	std::vector<uint8_t, LockedAllocator<uint8_t>> data; // pre-faulted, locked with --lock-memory
+	FrameFormat format;
+	int width;
+	int height;
+	int stride;        // bytes per row (of each plane for NV12)
+	uint32_t sequence; // frame sequence number from libcamera
+	RawInfo raw;       // Bayer formats only
+
+	// Capture metadata, when the camera reports it
+	float   lux           = -1; // scene illuminance estimated by the ISP
+	int32_t exposure_us   = 0;
+	float   analogue_gain = 0;
+
+	FrameView view () const {return {data.data(), format, width, height, stride, sequence, raw};}
+};
+
+#endif // CAMERA_FRAME_H
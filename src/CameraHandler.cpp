@@ -1,13 +1,78 @@
 #include "CameraHandler.h"
+#include "Kernels.h"
+#include "PipelineMetrics.h"
+#include "Tracer.h"
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <linux/dma-buf.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 
-// OpenCV for potential image conversion if needed (e.g., YUV to BGR)
-#include <opencv2/opencv.hpp>
 #include <libcamera/libcamera.h>
 
 using namespace libcamera;
 
+// Raw sensor formats the Bayer kernels handle
+struct RawFormat
+{
+	PixelFormat  pixel_format;
+	FrameFormat  format;
+	BayerOrder   order;
+	int          bit_depth;
+};
+
+static const std::vector<RawFormat> &rawFormats ()
+{
+	static const std::vector<RawFormat> raw_formats = {
+		{formats::SRGGB10_CSI2P, FrameFormat::Bayer10P, BayerOrder::RGGB, 10},
+		{formats::SGRBG10_CSI2P, FrameFormat::Bayer10P, BayerOrder::GRBG, 10},
+		{formats::SGBRG10_CSI2P, FrameFormat::Bayer10P, BayerOrder::GBRG, 10},
+		{formats::SBGGR10_CSI2P, FrameFormat::Bayer10P, BayerOrder::BGGR, 10},
+		{formats::SRGGB10, FrameFormat::Bayer16, BayerOrder::RGGB, 10},
+		{formats::SGRBG10, FrameFormat::Bayer16, BayerOrder::GRBG, 10},
+		{formats::SGBRG10, FrameFormat::Bayer16, BayerOrder::GBRG, 10},
+		{formats::SBGGR10, FrameFormat::Bayer16, BayerOrder::BGGR, 10},
+		{formats::SRGGB12, FrameFormat::Bayer16, BayerOrder::RGGB, 12},
+		{formats::SGRBG12, FrameFormat::Bayer16, BayerOrder::GRBG, 12},
+		{formats::SGBRG12, FrameFormat::Bayer16, BayerOrder::GBRG, 12},
+		{formats::SBGGR12, FrameFormat::Bayer16, BayerOrder::BGGR, 12},
+	};
+	return raw_formats;
+}
+
+// CPU reads of a capture buffer, bracketed so that they see what the ISP wrote even through a
+// cached mapping (DMA_BUF_IOCTL_SYNC: cache invalidation at the start, release at the end)
+class DmaBufReadAccess
+{
+public:
+	explicit DmaBufReadAccess (int fd) : fd_(fd) {sync(DMA_BUF_SYNC_START);}
+	~DmaBufReadAccess () {sync(DMA_BUF_SYNC_END);}
+
+private:
+	int const fd_;
+
+	void sync (uint64_t flags)
+	{
+		dma_buf_sync sync = {flags | DMA_BUF_SYNC_READ};
+		while (ioctl(fd_, DMA_BUF_IOCTL_SYNC, &sync) < 0 && (errno == EINTR || errno == EAGAIN)) {}
+	}
+};
+
+static void plainCopy (const uint8_t *src, uint8_t *dst, size_t size)
+{
+	std::memcpy(dst, src, size);
+}
+
+static const RawFormat *findRawFormat (const PixelFormat &pixel_format)
+{
+	for (const RawFormat &raw_format : rawFormats())
+		if (raw_format.pixel_format == pixel_format) return &raw_format;
+	return nullptr;
+}
+
 CameraHandler::CameraHandler (std::function<void(const CameraFrame&)> callback) :
 	frame_callback_(callback),
 	camera_manager_(std::make_unique<CameraManager>()),
@@ -21,11 +86,14 @@ CameraHandler::~CameraHandler ()
 		camera_->stop();
 		camera_->release();
 	}
+	for (const MappedBuffer &mapping : mappings_)
+		munmap(const_cast<uint8_t*>(mapping.data), mapping.size);
 	if (allocator_) allocator_->free(stream_);
 	if (camera_manager_) camera_manager_->stop();
+	if (jpeg_decoder_) tjDestroy(jpeg_decoder_);
 }
 
-bool CameraHandler::init (unsigned width, unsigned height)
+bool CameraHandler::init (unsigned width, unsigned height, bool raw)
 {
 	if (camera_manager_->start() != 0) {
 		std::cerr << "Failed to start camera manager." << std::endl;
@@ -54,10 +122,12 @@ bool CameraHandler::init (unsigned width, unsigned height)
 	}
 
 	// Configure camera stream
-	std::unique_ptr<CameraConfiguration> config = camera_->generateConfiguration({StreamRole::StillCapture});
+	std::unique_ptr<CameraConfiguration> config = camera_->generateConfiguration({raw ? StreamRole::Raw : StreamRole::StillCapture});
 
 	// Set pixel format and resolution
-	config->at(0).pixelFormat = formats::NV12; // NV12 is a semi-planar YUV format (Y plane, UV (interleaved) plane)
+	if (!raw)
+		config->at(0).pixelFormat = formats::NV12; // NV12 is a semi-planar YUV format (Y plane, UV (interleaved) plane)
+	// else the sensor's native format: the validation picks the sensor mode and its packing
 	config->at(0).size = {width, height};
 	config->at(0).bufferCount = 1; // lowest possible for low latency, although libcamera seems to increase it to 4...
 
@@ -67,6 +137,18 @@ bool CameraHandler::init (unsigned width, unsigned height)
 		camera_manager_->stop();
 		return false;
 	}
+	if (raw) {
+		const RawFormat *raw_format = findRawFormat(config->at(0).pixelFormat);
+		if (!raw_format) {
+			std::cerr << "Unsupported raw format: " << config->at(0).pixelFormat.toString() << std::endl;
+			camera_->release();
+			camera_manager_->stop();
+			return false;
+		}
+		raw_info_.order = raw_format->order;
+		raw_info_.bit_depth = raw_format->bit_depth;
+		raw_info_.black_level = 64 << (raw_format->bit_depth - 10); // until the metadata tells
+	}
 
 	if (camera_->configure(config.get()) != 0) {
 		std::cerr << "Failed to configure camera." << std::endl;
@@ -75,27 +157,66 @@ bool CameraHandler::init (unsigned width, unsigned height)
 		return false;
 	}
 
-	// Allocate buffers for frame capture
+	// Allocate buffers for frame capture: ours from the dma-heap, or libcamera's
 	stream_ = config->at(0).stream();
-	allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
-	if (allocator_->allocate(stream_) < 0) {
-		std::cerr << "Failed to allocate buffers." << std::endl;
-		camera_->release();
-		camera_manager_->stop();
-		return false;
+	std::vector<FrameBuffer*> buffers;
+	if (dma_heap_) {
+		if (!importBuffers(config->at(0), buffers)) {
+			camera_->release();
+			camera_manager_->stop();
+			return false;
+		}
+	} else {
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		if (allocator_->allocate(stream_) < 0) {
+			std::cerr << "Failed to allocate buffers." << std::endl;
+			camera_->release();
+			camera_manager_->stop();
+			return false;
+		}
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream_))
+			buffers.push_back(buffer.get());
 	}
 
+	// Every buffer is mapped once, for good: its cookie indexes its mapping
+	for (FrameBuffer *buffer : buffers) {
+		size_t length = 0;
+		for (const FrameBuffer::Plane &plane : buffer->planes()) // planes share the fd (offsets from its start)
+			length = std::max<size_t>(length, plane.offset + plane.length);
+		void *mem = mmap(NULL, length, PROT_READ, MAP_SHARED, buffer->planes()[0].fd.get(), 0);
+		if (mem == MAP_FAILED) {
+			std::cerr << "Failed to mmap buffer! Errno: " << errno << " (" << strerror(errno) << ")" << std::endl;
+			return false;
+		}
+		buffer->setCookie(mappings_.size());
+		mappings_.push_back({static_cast<const uint8_t*>(mem), length, buffer->planes()[0].fd.get()});
+	}
+
+	if (capture_read_ == CaptureRead::Auto)
+		chooseCaptureRead(config->at(0).pixelFormat == formats::MJPEG);
+
+	// Frame rate range, for the idle mode
+	auto duration_limits = camera_->controls().find(&controls::FrameDurationLimits);
+	if (duration_limits != camera_->controls().end()) {
+		frame_duration_min_ = duration_limits->second.min().get<int64_t>();
+		frame_duration_max_ = duration_limits->second.max().get<int64_t>();
+	}
+
+	// Field of view the ISP can crop from, for the ROI
+	if (!raw && camera_->controls().find(&controls::ScalerCrop) != camera_->controls().end())
+		crop_maximum_ = camera_->properties().get(properties::ScalerCropMaximum).value_or(Rectangle());
+
 	// Connect the callback for completed requests
 	camera_->requestCompleted.connect(this, &CameraHandler::requestComplete);
 
 	// Create requests by associating them with allocated buffers
-	for (unsigned int i = 0; i < config->at(0).bufferCount; ++i) {
+	for (FrameBuffer *buffer : buffers) {
 		std::unique_ptr<Request> request = camera_->createRequest();
 		if (!request) {
 			std::cerr << "Failed to create request." << std::endl;
 			return false;
 		}
-		if (request->addBuffer(stream_, allocator_->buffers(stream_)[i++].get()) != 0) {
+		if (request->addBuffer(stream_, buffer) != 0) {
 			std::cerr << "Failed to add buffer to request." << std::endl;
 			return false;
 		}
@@ -105,15 +226,100 @@ bool CameraHandler::init (unsigned width, unsigned height)
 	std::cout
 		<< "Camera initialized: " << config->at(0).size.width << "×" << config->at(0).size.height
 		<< " (" << config->at(0).pixelFormat.toString() << ")"
-		<< ", " << config->at(0).bufferCount << " buffers"
+		<< ", " << buffers.size() << " buffers"
+		<< (dma_heap_ ? " from dma-heap " + dma_heap_->name() + (dma_heap_->cached() ? " (cached)" : " (uncached)") : "")
 		<< std::endl;
 
 	return true;
 }
 
+void CameraHandler::chooseCaptureRead (bool compressed)
+{
+	// Both strategies on the first capture buffer, as requestComplete() would read it: the frame copy
+	// for raw and NV12 frames, a byte-serial pass (as entropy decoding) for compressed ones
+	const MappedBuffer &mapping = mappings_[0];
+	std::vector<uint8_t, LockedAllocator<uint8_t>> copy(mapping.size), staging(mapping.size);
+	volatile uint32_t sink = 0;
+	auto byteSerial = [&sink] (const uint8_t *data, size_t size) {
+		uint32_t hash = 0;
+		for (size_t i = 0; i < size; ++i) hash = hash * 31 + data[i];
+		sink = hash;
+	};
+	auto best = [&mapping] (const std::function<void()> &read) {
+		double best_us = 1e30;
+		for (int run = 0; run < 5; ++run) { // the first one faults the mapping in
+			auto start = std::chrono::steady_clock::now();
+			{
+				DmaBufReadAccess access(mapping.fd);
+				read();
+			}
+			best_us = std::min(best_us, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best_us;
+	};
+	const double direct_us = best([&] {
+		if (compressed) byteSerial(mapping.data, mapping.size);
+		else std::memcpy(copy.data(), mapping.data, mapping.size);
+	});
+	const double staged_us = best([&] {
+		streamCopy(mapping.data, compressed ? staging.data() : copy.data(), mapping.size);
+		if (compressed) byteSerial(staging.data(), mapping.size);
+	});
+	capture_read_ = staged_us < direct_us ? CaptureRead::Staged : CaptureRead::Direct;
+	std::cout
+		<< "Capture reads: direct " << direct_us << " µs, staged " << staged_us << " µs per frame, using "
+		<< (capture_read_ == CaptureRead::Staged ? "staged" : "direct") << " reads" << std::endl;
+}
+
+bool CameraHandler::setDmaHeap (const std::string &heap)
+{
+	dma_heap_ = std::make_unique<DmaHeap>(heap);
+	if (!dma_heap_->valid()) {
+		dma_heap_.reset();
+		return false;
+	}
+	return true;
+}
+
+bool CameraHandler::importBuffers (const StreamConfiguration &stream_config, std::vector<FrameBuffer*> &buffers)
+{
+	// Planes as libcamera lays them out for the format: NV12's UV plane follows the Y plane in the
+	// same dma-buf. Buffers are page-aligned, and so are rows when the stride is a multiple of 64.
+	const unsigned stride = stream_config.stride, height = stream_config.size.height;
+	std::vector<std::pair<unsigned, unsigned>> planes; // offset, length
+	if (stream_config.pixelFormat == formats::NV12)
+		planes = {{0, stride * height}, {stride * height, stride * (height / 2)}};
+	else
+		planes = {{0, stream_config.frameSize ? stream_config.frameSize : stride * height}};
+	const size_t size = planes.back().first + planes.back().second;
+
+	for (unsigned i = 0; i < stream_config.bufferCount; ++i) {
+		int fd = dma_heap_->alloc("raspizza-capture" + std::to_string(i), size);
+		if (fd < 0) return false;
+		SharedFD shared_fd(std::move(fd)); // takes the fd over
+		std::vector<FrameBuffer::Plane> frame_planes;
+		for (const auto &plane : planes) {
+			FrameBuffer::Plane frame_plane;
+			frame_plane.fd = shared_fd;
+			frame_plane.offset = plane.first;
+			frame_plane.length = plane.second;
+			frame_planes.push_back(frame_plane);
+		}
+		imported_buffers_.push_back(std::make_unique<FrameBuffer>(frame_planes));
+		buffers.push_back(imported_buffers_.back().get());
+	}
+	if (stride % 64)
+		std::cout << "Capture rows aren't 64-byte aligned (stride " << stride << ")" << std::endl;
+	return true;
+}
+
 bool CameraHandler::start ()
 {
-	if (camera_->start() != 0) {
+	ControlList controls;
+	Rectangle crop;
+	if (roiCrop(crop))
+		controls.set(controls::ScalerCrop, crop);
+	if (camera_->start(&controls) != 0) {
 		std::cerr << "Failed to start camera." << std::endl;
 		return false;
 	}
@@ -131,78 +337,172 @@ void CameraHandler::stop ()
 	camera_->stop();
 }
 
+void CameraHandler::setRoi (float x, float y, float width, float height)
+{
+	std::lock_guard<std::mutex> lock(roi_mutex_);
+	roi_[0] = x;
+	roi_[1] = y;
+	roi_[2] = width;
+	roi_[3] = height;
+	roi_changed_ = true;
+}
+
+bool CameraHandler::roiCrop (Rectangle &crop)
+{
+	float roi[4];
+	{
+		std::lock_guard<std::mutex> lock(roi_mutex_);
+		if (!roi_changed_) return false;
+		roi_changed_ = false;
+		std::copy(roi_, roi_ + 4, roi);
+	}
+	if (crop_maximum_.width == 0 || crop_maximum_.height == 0) {
+		std::cerr << "The camera can't crop to the ROI." << std::endl;
+		return false;
+	}
+
+	// Widened (never narrowed) to the stream aspect ratio, so the ISP scaling doesn't distort,
+	// then shifted back inside the field of view
+	const double max_width = crop_maximum_.width, max_height = crop_maximum_.height;
+	const double aspect = double(stream_->configuration().size.width) / stream_->configuration().size.height;
+	double width  = max_width  * std::min(1.f, std::max(0.05f, roi[2]));
+	double height = max_height * std::min(1.f, std::max(0.05f, roi[3]));
+	const double center_x = max_width  * (roi[0] + roi[2] / 2);
+	const double center_y = max_height * (roi[1] + roi[3] / 2);
+	if (width / height < aspect) width = height * aspect;
+	else height = width / aspect;
+	if (width > max_width) {
+		width = max_width;
+		height = width / aspect;
+	}
+	if (height > max_height) {
+		height = max_height;
+		width = height * aspect;
+	}
+	const double x = std::min(max_width - width, std::max(0.0, center_x - width / 2));
+	const double y = std::min(max_height - height, std::max(0.0, center_y - height / 2));
+	crop = Rectangle(crop_maximum_.x + int(x), crop_maximum_.y + int(y), unsigned(width), unsigned(height));
+	std::cout << "Camera crop: " << crop.toString() << std::endl;
+	return true;
+}
+
 // callback called by libcamera when a request is completed
 void CameraHandler::requestComplete (Request *request)
 {
-	// prepare variables for future mmap:
 	size_t total_buffer_length = 0;
-	void *mem = MAP_FAILED;
+	const void *mem = nullptr;
 
 	if (request->status() == Request::RequestComplete) {
-		// request->buffers() is a map between the various streams and their buffers; it uses the first (and only) stream
-		const FrameBuffer *buffer = request->buffers().begin()->second;
-		const FrameBuffer::Plane &plane0 = buffer->planes()[0]; // Plan Y for NV12
-
-		int stride = stream_->configuration().stride;
-		PixelFormat pixel_format = stream_->configuration().pixelFormat;
-
-		std::cout
-			<< "Received " << pixel_format.toString() << " frame"
-			<< " with " << buffer->planes().size()
-			<< " planes:";
-		for (const auto &plane : buffer->planes()) {
-			std::cout << " " << plane.length << "@FD=" << plane.fd.get();
-			total_buffer_length += plane.length;
-		}
-		std::cout << std::endl;
+		// Frames (and their buffers) are recycled from one request to the next
+		std::shared_ptr<CameraFrame> frame = frame_pool_.acquire();
+		frame->sequence = request->sequence();
+		const ControlList &metadata = request->metadata();
+		frame->lux           = metadata.get(controls::Lux).value_or(-1.f);
+		frame->exposure_us   = metadata.get(controls::ExposureTime).value_or(0);
+		frame->analogue_gain = metadata.get(controls::AnalogueGain).value_or(0.f);
+		Tracer::setFrame(frame->sequence);
+		{ // capture stage: copy out of the camera buffer
+			ScopedStage capture_stage(PipelineMetrics::Capture);
 
-		// The length of the mmap must be the total length of all mapped planes
-		// In the case of NV12, the second plane (UV) begins immediately after the first (Y) on the same FD
-		mem = mmap(NULL, total_buffer_length, PROT_READ, MAP_SHARED, plane0.fd.get(), 0);
-		if (mem == MAP_FAILED) {
-			std::cerr << "Failed to mmap buffer! Errno: " << errno << " (" << strerror(errno) << ")" << std::endl;
-			goto bailout;
-		}
+			// request->buffers() is a map between the various streams and their buffers; it uses the first (and only) stream
+			const FrameBuffer *buffer = request->buffers().begin()->second;
+			const MappedBuffer &mapping = mappings_[buffer->cookie()];
+			DmaBufReadAccess access(mapping.fd); // until the end of the stage
+			const bool staged = capture_read_ == CaptureRead::Staged;
+			void (*copy)(const uint8_t*, uint8_t*, size_t) = staged ? streamCopy : plainCopy;
+			const FrameBuffer::Plane &plane0 = buffer->planes()[0]; // Plan Y for NV12
+
+			int stride = stream_->configuration().stride;
+			PixelFormat pixel_format = stream_->configuration().pixelFormat;
 
-		// Convert the image to RGB format via OpenCV
-		cv::Mat bgr_image;
-		if (pixel_format == libcamera::formats::NV12) {
-			// --- Conversion from NV12 to BGR ---
-			// Create the Mat NV12, using the total buffer height (Y + UV) and stride
-			// The Mat must represent the entire YUV buffer
-			int img_width  = stream_->configuration().size.width;
-			int img_height = stream_->configuration().size.height;
-			cv::Mat nv12_image(img_height + img_height / 2, img_width, CV_8UC1, mem, stride);
-			cv::cvtColor(nv12_image, bgr_image, cv::COLOR_YUV2BGR_NV12);
-		} else if (pixel_format == libcamera::formats::MJPEG) {
-			// --- Conversion from MJPEG to BGR ---
-			cv::Mat mjpeg_data(1, total_buffer_length, CV_8UC1, mem);
-			bgr_image = cv::imdecode(mjpeg_data, cv::IMREAD_COLOR);
-			if (bgr_image.empty()) {
-				std::cerr << "Failed to decode MJPEG frame!" << std::endl;
+			// In the case of NV12, the second plane (UV) begins immediately after the first (Y) on the same FD
+			mem = mapping.data;
+			total_buffer_length = mapping.size;
+
+			if (pixel_format == libcamera::formats::NV12) {
+				// NV12 is copied as is, the conversion is up to the next stage
+				const uint8_t *y_plane = static_cast<const uint8_t*>(mem) + plane0.offset;
+				const uint8_t *uv_plane = buffer->planes().size() > 1
+					? static_cast<const uint8_t*>(mem) + buffer->planes()[1].offset
+					: y_plane + stride * stream_->configuration().size.height;
+				frame->format = FrameFormat::NV12;
+				frame->width  = stream_->configuration().size.width;
+				frame->height = stream_->configuration().size.height;
+				frame->stride = stride;
+				frame->data.resize(stride * (frame->height + frame->height / 2));
+				copy(y_plane, frame->data.data(), stride * frame->height);
+				copy(uv_plane, frame->data.data() + stride * frame->height, stride * (frame->height / 2));
+			} else if (pixel_format == libcamera::formats::MJPEG) {
+				// --- Conversion from MJPEG to BGR ---
+				ScopedStage conversion_stage(PipelineMetrics::Conversion);
+				const unsigned char *jpeg = static_cast<const unsigned char*>(mem);
+				if (staged) { // the decoder reads byte by byte
+					staging_.resize(total_buffer_length);
+					streamCopy(jpeg, staging_.data(), total_buffer_length);
+					jpeg = staging_.data();
+				}
+				int width, height, subsampling, colorspace;
+				if (!jpeg_decoder_) jpeg_decoder_ = tjInitDecompress();
+				if (!jpeg_decoder_
+					|| tjDecompressHeader3(jpeg_decoder_, jpeg, total_buffer_length, &width, &height, &subsampling, &colorspace) != 0) {
+					std::cerr << "Failed to decode MJPEG frame!" << std::endl;
+					goto bailout;
+				}
+				frame->format = FrameFormat::BGR;
+				frame->width  = width;
+				frame->height = height;
+				frame->stride = width * 3;
+				frame->data.resize(frame->stride * height);
+				if (tjDecompress2(jpeg_decoder_, jpeg, total_buffer_length, frame->data.data(), width, frame->stride, height, TJPF_BGR, TJFLAG_FASTDCT) != 0) {
+					std::cerr << "Failed to decode MJPEG frame: " << tjGetErrorStr2(jpeg_decoder_) << std::endl;
+					goto bailout;
+				}
+			} else if (const RawFormat *raw_format = findRawFormat(pixel_format)) {
+				// Raw Bayer mosaic, copied as is: demosaicing is fused with the downscale to the model input
+				frame->format = raw_format->format;
+				frame->width  = stream_->configuration().size.width;
+				frame->height = stream_->configuration().size.height;
+				frame->stride = stride;
+				frame->data.resize(size_t(stride) * frame->height);
+				copy(static_cast<const uint8_t*>(mem) + plane0.offset, frame->data.data(), frame->data.size());
+
+				// Levels of this frame from the IPA: black level (16-bit scale) and white balance
+				frame->raw = raw_info_;
+				if (auto black_levels = metadata.get(controls::SensorBlackLevels)) {
+					const int32_t *levels = black_levels->data();
+					frame->raw.black_level = ((levels[0] + levels[1] + levels[2] + levels[3]) / 4) >> (16 - raw_format->bit_depth);
+				}
+				if (auto colour_gains = metadata.get(controls::ColourGains)) {
+					frame->raw.gains[0] = (*colour_gains)[0];
+					frame->raw.gains[1] = 1.f;
+					frame->raw.gains[2] = (*colour_gains)[1];
+				}
+			} else {
+				std::cerr << "Skipping unsupported frame." << std::endl;
 				goto bailout;
 			}
-			std::cout << "Decoded  MJPEG frame: " << bgr_image.cols << "×" << bgr_image.rows << std::endl;
-		} else {
-			std::cerr << "Skipping unsupported frame." << std::endl;
-			goto bailout;
 		}
 
 		// Pass frame to next stage:
-		if (frame_callback_) {
-			CameraFrame frame;
-			frame.width  = bgr_image.cols;
-			frame.height = bgr_image.rows;
-			frame.data.assign(bgr_image.data, bgr_image.data + (frame.width * frame.height * bgr_image.channels()));
-			frame_callback_(frame);
-		}
+		if (frame_callback_)
+			frame_callback_(*frame);
 
 	} else { // means request->status() != Request::RequestComplete
 		std::cerr << "Request failed: " << request->status() << std::endl;
 	}
 
 bailout:
-	if (mem != MAP_FAILED) munmap(mem, total_buffer_length);
 	request->reuse(Request::ReuseBuffers);
+	bool idle = idle_;
+	if (idle != idle_applied_ && frame_duration_max_ > 0) {
+		// Idle pins the longest frame duration; awake restores the full range to the AGC
+		const std::array<int64_t, 2> limits = {idle ? frame_duration_max_ : frame_duration_min_, frame_duration_max_};
+		request->controls().set(controls::FrameDurationLimits, Span<const int64_t, 2>(limits.data(), limits.size()));
+		idle_applied_ = idle;
+		std::cout << (idle ? "Camera idle: " : "Camera awake: ") << 1e6 / limits[0] << " fps max" << std::endl;
+	}
+	Rectangle crop;
+	if (roiCrop(crop))
+		request->controls().set(controls::ScalerCrop, crop); // sticks for the following requests
 	camera_->queueRequest(request);
 }
\ No newline at end of file
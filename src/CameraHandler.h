@@ -2,8 +2,18 @@
 #define CAMERA_HANDLER_H
 
 #include <libcamera/libcamera.h>
+#include <turbojpeg.h>
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <string>
+#include <mutex>
+
+#include "CameraFrame.h"
+#include "DmaHeap.h"
+#include "FramePool.h"
 
 // Forward declarations for libcamera
 namespace libcamera {
@@ -14,11 +24,11 @@ namespace libcamera {
 	class Request;
 }
 
-// Structure for an acquired frame
-struct CameraFrame {
-	std::vector<uint8_t> data;
-	int width;
-	int height;
+// How requestComplete() reads the mapped capture buffers
+enum class CaptureRead {
+	Auto,   // the faster of the two, measured at init()
+	Direct, // copy or decode straight from the mapping
+	Staged, // stream it with wide loads into cached memory first
 };
 
 class CameraHandler
@@ -27,20 +37,66 @@ public:
 	 CameraHandler (const std::function<void(const CameraFrame&)> callback);
 	~CameraHandler ();
 
-	bool init  (unsigned width, unsigned height);
+	// raw: the sensor's Bayer mosaic (StreamRole::Raw) instead of ISP-processed NV12, at the sensor
+	// mode closest to width × height; FramePipeline demosaics it by binning
+	bool init  (unsigned width, unsigned height, bool raw = false);
+	// Before init(): capture buffers allocated from a dma-heap (see DmaHeap) rather than by
+	// libcamera, so that their caching and alignment are ours to choose
+	bool setDmaHeap (const std::string &heap);
+	// Before init()
+	void setCaptureRead (CaptureRead read) {capture_read_ = read;}
 	bool start ();  // Starts streaming
 	void stop  ();  // Stops streaming
 
+	// Idle: the camera runs at its minimum frame rate (longest frame duration) until woken up.
+	// Thread-safe, applied with the next queued request.
+	void setIdle (bool idle) {idle_ = idle;}
+
+	// Region of interest, normalized to the full field of view (0..1). The ISP crops to it
+	// (ScalerCrop) and scales it to the stream size, so the frames only hold the region, at a
+	// higher resolution. Widened to the stream aspect ratio. Can be changed at any time (e.g. by
+	// a tracker), thread-safe, applied with the next queued request. Not for raw streams.
+	void setRoi (float x, float y, float width, float height);
+
 private:
 	std::function<void(const CameraFrame&)> const frame_callback_;
 
 	std::unique_ptr<libcamera::CameraManager> camera_manager_;
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
+	std::unique_ptr<DmaHeap> dma_heap_;
+	std::vector<std::unique_ptr<libcamera::FrameBuffer>> imported_buffers_; // from dma_heap_
 	libcamera::Stream* stream_;
 	std::vector<std::unique_ptr<libcamera::Request>> requests_;
+	FramePool frame_pool_;
+
+	// Capture buffers stay mapped from init() on; indexed by FrameBuffer cookie
+	struct MappedBuffer
+	{
+		const uint8_t *data;
+		size_t size;
+		int fd; // dma-buf, owned by the FrameBuffer
+	};
+	std::vector<MappedBuffer> mappings_;
+	CaptureRead capture_read_ = CaptureRead::Auto; // Direct or Staged once init() has chosen
+	std::vector<uint8_t, LockedAllocator<uint8_t>> staging_; // compressed frames, with staged reads
+	tjhandle jpeg_decoder_ = nullptr; // for MJPEG cameras, created on first use
+	RawInfo raw_info_; // raw stream: pattern and bit depth of the sensor format
+
+	std::atomic<bool> idle_{false};
+	bool idle_applied_ = false;     // state of the frame duration limits last sent to the camera
+	int64_t frame_duration_min_ = 0; // µs, from the camera controls; 0 if the camera has none
+	int64_t frame_duration_max_ = 0;
+
+	std::mutex roi_mutex_;       // protects roi_ and roi_changed_
+	float roi_[4] = {0, 0, 1, 1}; // x, y, width, height
+	bool roi_changed_ = false;
+	libcamera::Rectangle crop_maximum_; // full field of view, in sensor pixels; empty if the ISP can't crop
 
 	void requestComplete (libcamera::Request* request); // callback from libcamera
+	void chooseCaptureRead (bool compressed);
+	bool importBuffers (const libcamera::StreamConfiguration &stream_config, std::vector<libcamera::FrameBuffer*> &buffers);
+	bool roiCrop (libcamera::Rectangle &crop);           // pending ROI change as a ScalerCrop, if any
 };
 
 #endif // CAMERA_HANDLER_H
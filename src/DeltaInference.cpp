@@ -0,0 +1,286 @@
+#include "DeltaInference.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "Kernels.h"
+#include "PipelineMetrics.h"
+
+// First NHWC tensor of a signature's inputs or outputs
+template <class GetTensor>
+static const char *findImageTensor (const std::vector<const char*> &names, GetTensor tensor)
+{
+	for (const char *name : names)
+		if (tensor(name)->dims->size == 4)
+			return name;
+	return nullptr;
+}
+
+static std::vector<int> shapeOf (const TfLiteTensor *tensor)
+{
+	return std::vector<int>(tensor->dims->data, tensor->dims->data + tensor->dims->size);
+}
+
+bool DeltaInference::init (tflite::Interpreter &interpreter, const DeltaOptions &options, int width, int height, int channels, TfLiteType input_type)
+{
+	options_ = options;
+	options_.tile = std::max(1, options_.tile);
+	width_ = width;
+	height_ = height;
+	channels_ = channels;
+	input_type_ = input_type;
+
+	stem_ = interpreter.GetSignatureRunner(options_.stem_signature.c_str());
+	tail_ = interpreter.GetSignatureRunner(options_.tail_signature.c_str());
+	if (!stem_ || !tail_) {
+		std::cerr << "Delta inference needs the '" << options_.stem_signature << "' and '" << options_.tail_signature << "' signatures." << std::endl;
+		return false;
+	}
+
+	// Stem: full image to feature map, which sets the stride
+	const char *stem_input = findImageTensor(stem_->input_names(), [this] (const char *name) {return stem_->input_tensor(name);});
+	const char *stem_output = findImageTensor(stem_->output_names(), [this] (const char *name) {return stem_->output_tensor(name);});
+	if (!stem_input || !stem_output || stem_->input_names().size() != 1) {
+		std::cerr << "The stem must map the image alone to a feature map (NHWC)." << std::endl;
+		return false;
+	}
+	stem_input_ = stem_input;
+	stem_output_ = stem_output;
+	if (shapeOf(stem_->input_tensor(stem_input)) != std::vector<int>{1, height, width, channels}
+		|| stem_->input_tensor(stem_input)->type != input_type) {
+		std::cerr << "The stem input doesn't match the model input." << std::endl;
+		return false;
+	}
+	const TfLiteTensor *features = stem_->output_tensor(stem_output);
+	features_height_ = features->dims->data[1];
+	features_width_ = features->dims->data[2];
+	stride_ = features_height_ > 0 ? height / features_height_ : 0;
+	if (stride_ < 1 || features_height_ * stride_ != height || features_width_ * stride_ != width) {
+		std::cerr << "The stem must downscale the image by an integer factor." << std::endl;
+		return false;
+	}
+	const int feature_channels = features->dims->data[3];
+	cell_bytes_ = features->bytes / (features_width_ * features_height_);
+	const TfLiteType features_type = features->type;
+	const TfLiteQuantizationParams features_params = features->params;
+
+	// Patches: a tile and its halo, aligned on the stride so that the feature grids match
+	halo_ = (std::max(0, options_.halo) + stride_ - 1) / stride_ * stride_;
+	patch_width_ = options_.tile * stride_ + 2 * halo_;
+	patch_height_ = patch_width_;
+	if (patch_width_ >= width || patch_height_ >= height) {
+		std::cerr << "Delta tiles (" << patch_width_ << " px with their halo) don't fit in the " << width << "×" << height << " input." << std::endl;
+		return false;
+	}
+	if (stem_->ResizeInputTensor(stem_input, {1, patch_height_, patch_width_, channels}) != kTfLiteOk
+		|| stem_->AllocateTensors() != kTfLiteOk) {
+		std::cerr << "Failed to resize the stem to " << patch_width_ << "×" << patch_height_ << " patches." << std::endl;
+		return false;
+	}
+	if (shapeOf(stem_->output_tensor(stem_output)) != std::vector<int>{1, patch_height_ / stride_, patch_width_ / stride_, feature_channels}) {
+		std::cerr << "The stem isn't fully convolutional." << std::endl;
+		return false;
+	}
+
+	// Tail: bound to the cached feature map, which it must take as is
+	const char *tail_input = findImageTensor(tail_->input_names(), [this] (const char *name) {return tail_->input_tensor(name);});
+	const TfLiteTensor *tail_tensor = tail_input ? tail_->input_tensor(tail_input) : nullptr;
+	if (!tail_tensor || tail_->input_names().size() != 1
+		|| shapeOf(tail_tensor) != std::vector<int>{1, features_height_, features_width_, feature_channels}
+		|| tail_tensor->type != features_type
+		|| tail_tensor->params.scale != features_params.scale || tail_tensor->params.zero_point != features_params.zero_point) {
+		std::cerr << "The tail input doesn't match the stem output." << std::endl;
+		return false;
+	}
+	features_ = LockedBuffer(tail_tensor->bytes);
+	TfLiteCustomAllocation allocation = {features_.data(), tail_tensor->bytes};
+	if (!features_ || tail_->SetCustomAllocationForInputTensor(tail_input, allocation) != kTfLiteOk || tail_->AllocateTensors() != kTfLiteOk) {
+		std::cerr << "Failed to bind the feature map to the tail." << std::endl;
+		return false;
+	}
+	tail_output_ = nullptr;
+	for (const char *name : tail_->output_names()) {
+		const TfLiteTensor *tensor = tail_->output_tensor(name);
+		if (tensor->dims->size == 2 && tensor->dims->data[0] == 1) {
+			tail_output_ = tensor;
+			break;
+		}
+	}
+	if (!tail_output_) {
+		std::cerr << "No classification output in the tail. Expected a tensor of shape [1, N]." << std::endl;
+		return false;
+	}
+
+	tiles_x_ = (features_width_ + options_.tile - 1) / options_.tile;
+	tiles_y_ = (features_height_ + options_.tile - 1) / options_.tile;
+	reach_ = (halo_ + options_.tile * stride_ - 1) / (options_.tile * stride_);
+	reference_.assign(size_t(width) * height * channels, 0);
+	changed_.assign(tiles_x_ * tiles_y_, 0);
+	recompute_.assign(tiles_x_ * tiles_y_, 0);
+	valid_ = false;
+	frames_ = 0;
+
+	std::cout
+		<< "Delta inference: " << tiles_x_ << "×" << tiles_y_ << " tiles of " << options_.tile * stride_ << " px"
+		<< ", " << patch_width_ << " px patches, stride " << stride_ << std::endl;
+	return true;
+}
+
+// Whether any pixel of the tile differs from the reference by more than the threshold
+bool DeltaInference::tileChanged (const uint8_t *image, int tile_x, int tile_y) const
+{
+	const int tile_px = options_.tile * stride_;
+	const int x0 = tile_x * tile_px, x1 = std::min(width_, x0 + tile_px);
+	const int y0 = tile_y * tile_px, y1 = std::min(height_, y0 + tile_px);
+	const size_t row_bytes = size_t(x1 - x0) * channels_;
+	for (int y = y0; y < y1; ++y) {
+		size_t offset = (size_t(y) * width_ + x0) * channels_;
+		const uint8_t *a = image + offset, *b = reference_.data() + offset;
+		if (options_.pixel_threshold <= 0) {
+			if (std::memcmp(a, b, row_bytes)) return true;
+			continue;
+		}
+		for (size_t i = 0; i < row_bytes; ++i)
+			if (std::abs(a[i] - b[i]) > options_.pixel_threshold) return true;
+	}
+	return false;
+}
+
+// Runs the stem on the patch around a tile and stores the tile's features
+bool DeltaInference::computeTile (const uint8_t *image, int tile_x, int tile_y)
+{
+	const int fx0 = tile_x * options_.tile, fx1 = std::min(features_width_, fx0 + options_.tile);
+	const int fy0 = tile_y * options_.tile, fy1 = std::min(features_height_, fy0 + options_.tile);
+
+	// The patch stays inside the image: its borders are either the image's or at least a halo away
+	const int px = std::min(std::max(0, fx0 * stride_ - halo_), width_ - patch_width_);
+	const int py = std::min(std::max(0, fy0 * stride_ - halo_), height_ - patch_height_);
+	TfLiteTensor *input = stem_->input_tensor(stem_input_.c_str());
+	const size_t patch_row = size_t(patch_width_) * channels_;
+	for (int y = 0; y < patch_height_; ++y) {
+		const uint8_t *src = image + (size_t(py + y) * width_ + px) * channels_;
+		if (input_type_ == kTfLiteFloat32)
+			convertInputU8ToF32(src, input->data.f + y * patch_row, patch_row);
+		else
+			std::memcpy(input->data.uint8 + y * patch_row, src, patch_row);
+	}
+	if (stem_->Invoke() != kTfLiteOk) {
+		std::cerr << "Failed to invoke the stem." << std::endl;
+		return false;
+	}
+
+	const uint8_t *patch_features = stem_->output_tensor(stem_output_.c_str())->data.uint8;
+	const int patch_cells = patch_width_ / stride_;
+	for (int fy = fy0; fy < fy1; ++fy)
+		std::memcpy(features_.data() + (size_t(fy) * features_width_ + fx0) * cell_bytes_,
+		            patch_features + (size_t(fy - py / stride_) * patch_cells + (fx0 - px / stride_)) * cell_bytes_,
+		            (fx1 - fx0) * cell_bytes_);
+
+	// The tile's pixels are now those its features come from
+	const int x0 = fx0 * stride_, x1 = fx1 * stride_;
+	for (int y = fy0 * stride_; y < fy1 * stride_; ++y) {
+		size_t offset = (size_t(y) * width_ + x0) * channels_;
+		std::memcpy(reference_.data() + offset, image + offset, size_t(x1 - x0) * channels_);
+	}
+	return true;
+}
+
+const TfLiteTensor *DeltaInference::run (const uint8_t *image)
+{
+	ScopedStage stage(PipelineMetrics::Invoke);
+	const Clock::time_point start = Clock::now();
+	++frames_;
+
+	// A change reaches the tiles whose halo covers it
+	for (int ty = 0; ty < tiles_y_; ++ty)
+		for (int tx = 0; tx < tiles_x_; ++tx)
+			changed_[ty * tiles_x_ + tx] = !valid_ || tileChanged(image, tx, ty);
+	int recomputed = 0;
+	for (int ty = 0; ty < tiles_y_; ++ty) {
+		for (int tx = 0; tx < tiles_x_; ++tx) {
+			bool recompute = false;
+			for (int y = std::max(0, ty - reach_); y <= std::min(tiles_y_ - 1, ty + reach_) && !recompute; ++y)
+				for (int x = std::max(0, tx - reach_); x <= std::min(tiles_x_ - 1, tx + reach_) && !recompute; ++x)
+					recompute = changed_[y * tiles_x_ + x];
+			recompute_[ty * tiles_x_ + tx] = recompute;
+			recomputed += recompute;
+		}
+	}
+	for (int ty = 0; ty < tiles_y_; ++ty) {
+		for (int tx = 0; tx < tiles_x_; ++tx) {
+			if (recompute_[ty * tiles_x_ + tx] && !computeTile(image, tx, ty)) {
+				valid_ = false;
+				return nullptr;
+			}
+		}
+	}
+	valid_ = true;
+
+	if (tail_->Invoke() != kTfLiteOk) {
+		std::cerr << "Failed to invoke the tail." << std::endl;
+		return nullptr;
+	}
+
+	const double fraction = double(recomputed) / (tiles_x_ * tiles_y_);
+	const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	std::lock_guard<std::mutex> lock(mutex_);
+	Bin &bin = bins_[std::min(kFractionBins - 1, int(fraction * kFractionBins))];
+	++bin.frames;
+	bin.ms += ms;
+	recomputed_sum_ += fraction;
+	return tail_output_;
+}
+
+void DeltaInference::check (const std::vector<float> &delta, const std::vector<float> &full, double full_ms)
+{
+	float diff = delta.size() == full.size() ? 0 : INFINITY;
+	for (size_t i = 0; i < delta.size() && i < full.size(); ++i)
+		diff = std::max(diff, std::fabs(delta[i] - full[i]));
+	const bool mismatch = delta.empty() || full.empty()
+		|| std::max_element(delta.begin(), delta.end()) - delta.begin() != std::max_element(full.begin(), full.end()) - full.begin();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++full_count_;
+	full_ms_ += full_ms;
+	++checks_;
+	class_mismatches_ += mismatch;
+	last_abs_diff_ = diff;
+	max_abs_diff_ = std::max(max_abs_diff_, diff);
+}
+
+std::string DeltaInference::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	const double full_ms = full_count_ ? full_ms_ / full_count_ : 0;
+	uint64_t frames = 0;
+	for (const Bin &bin : bins_)
+		frames += bin.frames;
+	std::ostringstream json;
+	json
+		<< "{\"frames\":" << frames
+		<< ",\"tiles\":" << tiles_x_ * tiles_y_
+		<< ",\"tile_px\":" << options_.tile * stride_
+		<< ",\"halo_px\":" << halo_
+		<< ",\"pixel_threshold\":" << options_.pixel_threshold
+		<< ",\"recomputed_mean\":" << (frames ? recomputed_sum_ / frames : 0)
+		<< ",\"full_ms\":" << full_ms
+		<< ",\"by_recomputed_fraction\":[";
+	for (int b = 0; b < kFractionBins; ++b) {
+		const Bin &bin = bins_[b];
+		const double ms = bin.frames ? bin.ms / bin.frames : 0;
+		json
+			<< (b ? "," : "") << "{\"up_to\":" << double(b + 1) / kFractionBins
+			<< ",\"frames\":" << bin.frames
+			<< ",\"ms\":" << ms
+			<< ",\"speedup\":" << (ms > 0 && full_ms > 0 ? full_ms / ms : 0) << "}";
+	}
+	json
+		<< "],\"checks\":{\"count\":" << checks_
+		<< ",\"class_mismatches\":" << class_mismatches_
+		<< ",\"max_abs_diff\":" << max_abs_diff_
+		<< ",\"last_abs_diff\":" << last_abs_diff_ << "}}";
+	return json.str();
+}
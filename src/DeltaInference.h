@@ -0,0 +1,99 @@
+#ifndef DELTA_INFERENCE_H
+#define DELTA_INFERENCE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/signature_runner.h"
+
+#include "LockedMemory.h"
+
+// Experimental delta inference (ModelOptions::delta)
+struct DeltaOptions
+{
+	bool        enabled         = false;
+	std::string stem_signature  = "stem"; // image → feature map, purely convolutional
+	std::string tail_signature  = "tail"; // feature map → classification
+	int         tile            = 4;      // tile side, in feature cells
+	int         halo            = 16;     // input pixels recomputed around a tile, at least the stem's receptive-field radius
+	int         pixel_threshold = 0;      // a tile changed when a pixel differs by more (0: exact)
+	int         check_every     = 30;     // frames between checks against full inference (0: never)
+};
+
+// Reuses computation between consecutive frames of a fixed camera. The model exports, next to its
+// full signature, a "stem" (its early, purely convolutional layers) and a "tail" (the rest, from
+// the stem's feature map). The stem runs on patches of the input around the tiles that changed,
+// its outputs update a cached feature map, and the tail runs on the whole map.
+// With a halo covering the stem's receptive field, patches give the same features as a full
+// stem (patches are kept inside the image, so that convolutions pad the same way at its borders):
+// the result only differs from full inference by the changes below pixel_threshold.
+class DeltaInference
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// width, height, channels, input_type: image input of the full model
+	bool init (tflite::Interpreter &interpreter, const DeltaOptions &options, int width, int height, int channels, TfLiteType input_type);
+
+	// Recomputes the changed tiles and runs the tail; returns its classification output, null on failure
+	const TfLiteTensor *run (const uint8_t *image);
+	void invalidate () {valid_ = false;} // every tile recomputed on the next run
+
+	// Checks the last run against full inference of the same image (outputs as class confidences)
+	bool checkDue () const {return options_.check_every > 0 && frames_ > 0 && (frames_ - 1) % options_.check_every == 0;}
+	void check    (const std::vector<float> &delta, const std::vector<float> &full, double full_ms);
+
+	std::string toJson () const;
+
+private:
+	static constexpr int kFractionBins = 10; // by recomputed fraction of the tiles
+
+	DeltaOptions options_;
+	tflite::SignatureRunner *stem_ = nullptr;
+	tflite::SignatureRunner *tail_ = nullptr;
+	std::string stem_input_;
+	std::string stem_output_;
+	const TfLiteTensor *tail_output_ = nullptr;
+
+	int width_ = 0, height_ = 0, channels_ = 0;
+	TfLiteType input_type_ = kTfLiteNoType;
+	int stride_ = 1;                        // input pixels per feature cell
+	int features_width_ = 0, features_height_ = 0;
+	size_t cell_bytes_ = 0;                 // feature vector of a cell
+	int halo_ = 0;                          // rounded to the stride
+	int patch_width_ = 0, patch_height_ = 0;
+	int tiles_x_ = 0, tiles_y_ = 0;
+	int reach_ = 0;                         // tiles whose change reaches a tile through the halo
+
+	LockedBuffer features_;                 // cached feature map, bound to the tail input
+	std::vector<uint8_t> reference_;        // input each tile was last computed from
+	std::vector<uint8_t> changed_, recompute_;
+	bool valid_ = false;
+	uint64_t frames_ = 0;
+
+	// Statistics
+	struct Bin
+	{
+		uint64_t frames = 0;
+		double   ms     = 0;
+	};
+	mutable std::mutex mutex_; // protects the statistics
+	std::array<Bin, kFractionBins> bins_;
+	double   recomputed_sum_ = 0;
+	uint64_t full_count_ = 0;
+	double   full_ms_ = 0;
+	uint64_t checks_ = 0;
+	uint64_t class_mismatches_ = 0;
+	float    max_abs_diff_ = 0;
+	float    last_abs_diff_ = 0;
+
+	bool tileChanged  (const uint8_t *image, int tile_x, int tile_y) const;
+	bool computeTile  (const uint8_t *image, int tile_x, int tile_y);
+};
+
+#endif // DELTA_INFERENCE_H
@@ -0,0 +1,50 @@
+#include "DmaHeap.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <vector>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+DmaHeap::DmaHeap (const std::string &name)
+{
+	// Contiguous heaps of the Pi 5 ("vidbuf_cached") and of the Pi 4 / Zero 2 W ("linux,cma")
+	const std::vector<std::string> candidates = name.empty() ? std::vector<std::string>{"vidbuf_cached", "linux,cma"} : std::vector<std::string>{name};
+	for (const std::string &candidate : candidates) {
+		fd_ = open(("/dev/dma_heap/" + candidate).c_str(), O_RDWR | O_CLOEXEC);
+		if (fd_ >= 0) {
+			name_ = candidate;
+			return;
+		}
+	}
+	std::cerr << "No dma-heap " << (name.empty() ? "linux,cma" : name) << ": " << strerror(errno) << std::endl;
+}
+
+DmaHeap::~DmaHeap ()
+{
+	if (fd_ >= 0) close(fd_);
+}
+
+bool DmaHeap::cached () const
+{
+	return name_.find("uncached") == std::string::npos;
+}
+
+int DmaHeap::alloc (const std::string &buffer_name, size_t size)
+{
+	if (fd_ < 0) return -1;
+
+	const size_t page = sysconf(_SC_PAGESIZE);
+	dma_heap_allocation_data allocation = {};
+	allocation.len = (size + page - 1) / page * page;
+	allocation.fd_flags = O_RDWR | O_CLOEXEC;
+	if (ioctl(fd_, DMA_HEAP_IOCTL_ALLOC, &allocation) < 0) {
+		std::cerr << "Failed to allocate " << allocation.len << " bytes from dma-heap " << name_ << ": " << strerror(errno) << std::endl;
+		return -1;
+	}
+	ioctl(allocation.fd, DMA_BUF_SET_NAME, buffer_name.c_str()); // for /sys/kernel/debug/dma_buf, best effort
+	return allocation.fd;
+}
@@ -0,0 +1,34 @@
+#ifndef DMA_HEAP_H
+#define DMA_HEAP_H
+
+#include <cstddef>
+#include <string>
+
+// Allocator of dma-bufs from a Linux dma-heap (/dev/dma_heap/<name>): memory the camera writes
+// into by file descriptor, allocated by the application so that its placement and CPU caching
+// are known. Buffers are page-aligned and can be shared with any dma-buf importer.
+class DmaHeap
+{
+public:
+	// name: heap under /dev/dma_heap, e.g. "linux,cma" (contiguous), "system", "system-uncached";
+	// empty: the first available contiguous heap, as the ISP needs on a Pi without IOMMU
+	explicit DmaHeap (const std::string &name = "");
+	~DmaHeap ();
+
+	DmaHeap (const DmaHeap&) = delete;
+	DmaHeap &operator= (const DmaHeap&) = delete;
+
+	bool valid () const {return fd_ >= 0;}
+	const std::string &name () const {return name_;}
+	// CPU mappings of the heap's buffers are cached (and then need DMA_BUF_IOCTL_SYNC around CPU access)
+	bool cached () const;
+
+	// New dma-buf of size bytes, rounded up to whole pages; returns its fd (owned by the caller) or -1
+	int alloc (const std::string &buffer_name, size_t size);
+
+private:
+	int fd_ = -1;
+	std::string name_;
+};
+
+#endif // DMA_HEAP_H
@@ -0,0 +1,256 @@
+#include "DriftMonitor.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static constexpr double kConfidencePSI = 0.25; // usual "significant shift" threshold
+static constexpr double kClassPSI      = 0.5;  // the class mix varies more over a day
+static constexpr int    kEvaluateEvery = 64;   // frames between evaluations
+
+static int binOf (float value)
+{
+	int bin = int(value * DriftMonitor::kBins);
+	return std::min(std::max(bin, 0), DriftMonitor::kBins - 1);
+}
+
+// Population stability index between two histograms, with smoothing for empty bins
+template <size_t N>
+static double psi (const std::array<uint32_t, N> &expected, const std::array<uint32_t, N> &actual)
+{
+	const double epsilon = 1e-4;
+	double expected_total = 0, actual_total = 0;
+	for (size_t i = 0; i < N; ++i) {
+		expected_total += expected[i];
+		actual_total   += actual[i];
+	}
+	if (expected_total == 0 || actual_total == 0) return 0;
+	double index = 0;
+	for (size_t i = 0; i < N; ++i) {
+		double p = std::max(actual[i] / actual_total, epsilon);
+		double q = std::max(expected[i] / expected_total, epsilon);
+		index += (p - q) * std::log(p / q);
+	}
+	return index;
+}
+
+void DriftMonitor::Sketch::merge (const Sketch &other)
+{
+	for (int i = 0; i < kBins; ++i) {
+		confidence[i] += other.confidence[i];
+		margin[i]     += other.margin[i];
+	}
+	for (int i = 0; i < kMaxClasses; ++i)
+		classes[i] += other.classes[i];
+	frames += other.frames;
+}
+
+float DriftMonitor::Sketch::quantile (const std::array<uint32_t, kBins> &bins, float q) const
+{
+	if (!frames) return 0;
+	uint64_t rank = uint64_t(q * frames), seen = 0;
+	for (int i = 0; i < kBins; ++i) {
+		if (seen + bins[i] > rank) // interpolated within the bin
+			return (i + float(rank - seen + 0.5f) / bins[i]) / kBins;
+		seen += bins[i];
+	}
+	return 1;
+}
+
+DriftMonitor::DriftMonitor (const std::string &reference_file, uint64_t reference_frames) :
+	reference_file_(reference_file),
+	reference_frames_(std::max<uint64_t>(reference_frames, kMinFrames)),
+	reference_ready_(false),
+	confidence_psi_(0),
+	class_psi_(0),
+	drifted_(false),
+	drifted_since_(0),
+	frames_(0)
+{
+	if (!reference_file_.empty() && loadReference()) {
+		reference_ready_ = true;
+		std::cout << "Drift reference loaded from " << reference_file_ << " (" << reference_.frames << " frames)" << std::endl;
+	}
+}
+
+void DriftMonitor::update (const std::vector<Detection> &detections, std::time_t now)
+{
+	// Top two classes
+	int top = -1;
+	float first = 0, second = 0;
+	for (const Detection &detection : detections) {
+		if (detection.confidence > first) {
+			second = first;
+			first = detection.confidence;
+			top = detection.class_id;
+		} else if (detection.confidence > second) {
+			second = detection.confidence;
+		}
+	}
+	if (top < 0) return;
+	const int confidence_bin = binOf(first), margin_bin = binOf(first - second);
+	const int class_slot = std::min(top, kMaxClasses - 1);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++frames_;
+
+	const int64_t hour = now / 3600;
+	HourBucket &bucket = hours_[hour % kHours];
+	if (bucket.hour != hour) {
+		bucket = HourBucket();
+		bucket.hour = hour;
+	}
+	for (Sketch *sketch : {&bucket.sketch, reference_ready_ ? nullptr : &reference_}) {
+		if (!sketch) continue;
+		++sketch->confidence[confidence_bin];
+		++sketch->margin[margin_bin];
+		++sketch->classes[class_slot];
+		++sketch->frames;
+	}
+
+	if (!reference_ready_) {
+		std::tm local;
+		localtime_r(&now, &local);
+		++reference_by_hour_[local.tm_hour][class_slot];
+		if (reference_.frames >= reference_frames_) {
+			reference_ready_ = true;
+			std::cout << "Drift reference captured (" << reference_.frames << " frames)" << std::endl;
+			if (!reference_file_.empty() && !saveReference())
+				std::cerr << "Failed to save the drift reference to " << reference_file_ << std::endl;
+		}
+		return;
+	}
+
+	if (frames_ % kEvaluateEvery == 0)
+		evaluate(now);
+}
+
+DriftMonitor::Sketch DriftMonitor::window (int64_t hour) const
+{
+	Sketch sketch;
+	for (int64_t h : {hour, hour - 1})
+		if (hours_[h % kHours].hour == h)
+			sketch.merge(hours_[h % kHours].sketch);
+	return sketch;
+}
+
+void DriftMonitor::evaluate (std::time_t now)
+{
+	Sketch recent = window(now / 3600);
+	if (recent.frames < kMinFrames) return;
+
+	confidence_psi_ = std::max(psi(reference_.confidence, recent.confidence), psi(reference_.margin, recent.margin));
+
+	// The class mix depends on the time of day: compare to the same hour if the reference covers it
+	std::tm local;
+	localtime_r(&now, &local);
+	const auto &same_hour = reference_by_hour_[local.tm_hour];
+	uint64_t same_hour_frames = 0;
+	for (uint32_t count : same_hour) same_hour_frames += count;
+	class_psi_ = psi(same_hour_frames >= kMinFrames ? same_hour : reference_.classes, recent.classes);
+
+	bool drifted = confidence_psi_ > kConfidencePSI || class_psi_ > kClassPSI;
+	if (drifted && !drifted_) {
+		drifted_since_ = now;
+		std::cerr << "Input drift detected: confidence PSI " << confidence_psi_ << ", class PSI " << class_psi_ << std::endl;
+	}
+	drifted_ = drifted;
+}
+
+bool DriftMonitor::drifted () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return drifted_;
+}
+
+// Text format: one "name values..." line per histogram
+bool DriftMonitor::loadReference ()
+{
+	std::ifstream file(reference_file_);
+	if (!file) return false;
+	std::string magic;
+	if (!(file >> magic) || magic != "raspizza-drift-reference-1") {
+		std::cerr << "Not a drift reference: " << reference_file_ << std::endl;
+		return false;
+	}
+	auto read = [&file] (const char *name, auto &values) {
+		std::string key;
+		if (!(file >> key) || key != name) return false;
+		for (auto &value : values)
+			if (!(file >> value)) return false;
+		return true;
+	};
+	std::array<uint64_t, 1> frames;
+	bool ok = read("frames", frames) && read("confidence", reference_.confidence)
+		&& read("margin", reference_.margin) && read("classes", reference_.classes);
+	for (int h = 0; ok && h < kHours; ++h)
+		ok = read("hour", reference_by_hour_[h]);
+	if (!ok) {
+		std::cerr << "Corrupted drift reference: " << reference_file_ << std::endl;
+		reference_ = Sketch();
+		reference_by_hour_ = {};
+		return false;
+	}
+	reference_.frames = frames[0];
+	return true;
+}
+
+bool DriftMonitor::saveReference () const
+{
+	std::ofstream file(reference_file_);
+	auto write = [&file] (const char *name, const auto &values) {
+		file << name;
+		for (auto value : values) file << " " << value;
+		file << "\n";
+	};
+	file << "raspizza-drift-reference-1\n";
+	write("frames", std::array<uint64_t, 1>{reference_.frames});
+	write("confidence", reference_.confidence);
+	write("margin", reference_.margin);
+	write("classes", reference_.classes);
+	for (const auto &classes : reference_by_hour_)
+		write("hour", classes);
+	return bool(file);
+}
+
+std::string DriftMonitor::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::time_t now = std::time(nullptr);
+	Sketch recent = window(now / 3600);
+
+	std::ostringstream json;
+	json
+		<< "{\"frames\":" << frames_
+		<< ",\"reference_ready\":" << (reference_ready_ ? "true" : "false")
+		<< ",\"reference_frames\":" << reference_.frames
+		<< ",\"drift\":" << (drifted_ ? "true" : "false")
+		<< ",\"drift_since\":" << (drifted_ ? drifted_since_ : 0)
+		<< ",\"confidence_psi\":" << confidence_psi_
+		<< ",\"class_psi\":" << class_psi_;
+	auto quantiles = [&json] (const char *name, const Sketch &sketch) {
+		json
+			<< ",\"" << name << "\":{\"frames\":" << sketch.frames
+			<< ",\"confidence_p10\":" << sketch.quantile(sketch.confidence, 0.1f)
+			<< ",\"confidence_p50\":" << sketch.quantile(sketch.confidence, 0.5f)
+			<< ",\"confidence_p90\":" << sketch.quantile(sketch.confidence, 0.9f)
+			<< ",\"margin_p10\":" << sketch.quantile(sketch.margin, 0.1f)
+			<< ",\"margin_p50\":" << sketch.quantile(sketch.margin, 0.5f) << "}";
+	};
+	quantiles("recent", recent);
+	quantiles("reference", reference_);
+
+	// Class counts of each of the last 24 hours, oldest first
+	json << ",\"classes_by_hour\":[";
+	const int64_t hour = now / 3600;
+	for (int64_t h = hour - kHours + 1; h <= hour; ++h) {
+		const HourBucket &bucket = hours_[h % kHours];
+		json << (h > hour - kHours + 1 ? ",[" : "[");
+		for (int c = 0; c < kMaxClasses; ++c)
+			json << (c ? "," : "") << (bucket.hour == h ? bucket.sketch.classes[c] : 0);
+		json << "]";
+	}
+	json << "]}";
+	return json.str();
+}
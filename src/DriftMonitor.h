@@ -0,0 +1,74 @@
+#ifndef DRIFT_MONITOR_H
+#define DRIFT_MONITOR_H
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ModelInterpreter.h"
+
+// Watches the classifier outputs for a shift away from their distribution at deployment (new
+// camera angle, dirty lens, different lighting). Per frame it is O(1): fixed-bin sketches of the
+// top-1 confidence and of the top-1/top-2 margin, and class counters, bucketed per hour in a
+// ring of 24. The reference is captured from the first frames (or loaded from a file) and the
+// last hour is compared to it with the population stability index (PSI).
+class DriftMonitor
+{
+public:
+	static constexpr int      kBins       = 32; // sketch resolution over [0, 1]
+	static constexpr int      kMaxClasses = 16;
+	static constexpr int      kHours      = 24;
+	static constexpr uint64_t kMinFrames  = 300; // in the window before any verdict
+
+	// reference_file: loaded if it exists, otherwise written once the reference is captured
+	DriftMonitor (const std::string &reference_file = "", uint64_t reference_frames = 20000);
+
+	void update (const std::vector<Detection> &detections, std::time_t now = std::time(nullptr));
+
+	bool drifted () const;
+	std::string toJson () const;
+
+private:
+	// Mergeable histogram sketch of a frame population
+	struct Sketch
+	{
+		std::array<uint32_t, kBins> confidence{};
+		std::array<uint32_t, kBins> margin{};
+		std::array<uint32_t, kMaxClasses> classes{};
+		uint64_t frames = 0;
+
+		void  merge    (const Sketch &other);
+		float quantile (const std::array<uint32_t, kBins> &bins, float q) const;
+	};
+	struct HourBucket
+	{
+		int64_t hour = -1; // hours since the epoch
+		Sketch  sketch;
+	};
+
+	mutable std::mutex mutex_;
+	std::string const reference_file_;
+	uint64_t const reference_frames_;
+
+	std::array<HourBucket, kHours> hours_;
+	Sketch reference_;
+	std::array<std::array<uint32_t, kMaxClasses>, kHours> reference_by_hour_{}; // class counts per hour of the day
+	bool reference_ready_;
+
+	// Last evaluation
+	double confidence_psi_;
+	double class_psi_;
+	bool drifted_;
+	std::time_t drifted_since_;
+	uint64_t frames_;
+
+	void evaluate (std::time_t now);
+	Sketch window (int64_t hour) const; // current and previous hour
+	bool loadReference ();
+	bool saveReference () const;
+};
+
+#endif // DRIFT_MONITOR_H
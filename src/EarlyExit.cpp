@@ -0,0 +1,221 @@
+#include "EarlyExit.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "Kernels.h"
+#include "ModelInterpreter.h"
+#include "PipelineMetrics.h"
+
+bool parseClassThresholds (const std::string &text, std::vector<std::pair<std::string, float>> &thresholds)
+{
+	thresholds.clear();
+	std::istringstream stream(text);
+	for (std::string item; std::getline(stream, item, ',');) {
+		size_t equals = item.rfind('=');
+		if (equals == std::string::npos || equals == 0) return false;
+		char *end;
+		float threshold = strtof(item.c_str() + equals + 1, &end);
+		if (*end || end == item.c_str() + equals + 1) return false;
+		thresholds.emplace_back(item.substr(0, equals), threshold);
+	}
+	return !thresholds.empty();
+}
+
+bool EarlyExit::init (tflite::Interpreter &interpreter, const EarlyExitOptions &options, const std::vector<std::string> &class_labels,
+                      int width, int height, int channels, TfLiteType input_type)
+{
+	options_ = options;
+	input_type_ = input_type;
+
+	// Per-class thresholds
+	thresholds_.assign(class_labels.size(), options_.threshold);
+	for (const auto &threshold : options_.class_thresholds) {
+		auto it = std::find(class_labels.begin(), class_labels.end(), threshold.first);
+		if (it == class_labels.end()) {
+			std::cerr << "No class '" << threshold.first << "' for an exit threshold." << std::endl;
+			return false;
+		}
+		thresholds_[it - class_labels.begin()] = threshold.second;
+	}
+
+	// Segments, in the order of their numbers
+	segments_.clear();
+	for (int i = 0; ; ++i) {
+		std::string key = options_.segment_prefix + std::to_string(i);
+		tflite::SignatureRunner *runner = interpreter.GetSignatureRunner(key.c_str());
+		if (!runner) break;
+		Segment segment;
+		segment.runner = runner;
+		segment.key = key;
+		segments_.push_back(segment);
+	}
+	if (segments_.size() < 2) {
+		std::cerr << "Early exit needs the model's '" << options_.segment_prefix << "0', '" << options_.segment_prefix << "1'... signatures." << std::endl;
+		return false;
+	}
+
+	// The first segment takes the image alone
+	Segment &first = segments_.front();
+	if (first.runner->input_names().size() != 1) {
+		std::cerr << "Segment '" << first.key << "' must take the image alone." << std::endl;
+		return false;
+	}
+	const char *image_name = first.runner->input_names()[0];
+	const TfLiteTensor *image = first.runner->input_tensor(image_name);
+	if (image->dims->size != 4 || image->dims->data[1] != height || image->dims->data[2] != width || image->dims->data[3] != channels
+		|| image->type != input_type) {
+		std::cerr << "The input of segment '" << first.key << "' doesn't match the model input." << std::endl;
+		return false;
+	}
+	image_ = LockedBuffer(image->bytes);
+	TfLiteCustomAllocation allocation = {image_.data(), image->bytes};
+	if (!image_ || first.runner->SetCustomAllocationForInputTensor(image_name, allocation) != kTfLiteOk) {
+		std::cerr << "Failed to bind the input of segment '" << first.key << "'." << std::endl;
+		return false;
+	}
+
+	// Heads, and the links between the segments
+	links_.clear();
+	for (size_t i = 0; i < segments_.size(); ++i) {
+		Segment &segment = segments_[i];
+		for (const char *name : segment.runner->output_names()) {
+			const TfLiteTensor *tensor = segment.runner->output_tensor(name);
+			if (tensor->dims->size == 2 && tensor->dims->data[0] == 1 && tensor->dims->data[1] == (int) class_labels.size()) {
+				segment.head = tensor;
+				break;
+			}
+		}
+		if (i + 1 < segments_.size() && !link(segment, segments_[i + 1]))
+			return false;
+	}
+	if (!segments_.back().head) {
+		std::cerr << "The last segment has no classifier head. Expected a tensor of shape [1, " << class_labels.size() << "]." << std::endl;
+		return false;
+	}
+	for (Segment &segment : segments_) {
+		if (segment.runner->AllocateTensors() != kTfLiteOk) {
+			std::cerr << "Failed to allocate the tensors of segment '" << segment.key << "'." << std::endl;
+			return false;
+		}
+	}
+
+	std::cout << "Early exit: " << segments_.size() << " segments, heads after";
+	for (const Segment &segment : segments_)
+		if (segment.head) std::cout << " " << segment.key;
+	std::cout << std::endl;
+	return true;
+}
+
+// Binds each input of a segment to the output of the previous one with the same name, or else in
+// the same position among the outputs other than the head
+bool EarlyExit::link (Segment &from, Segment &to)
+{
+	std::vector<const char*> outputs;
+	for (const char *name : from.runner->output_names())
+		if (from.runner->output_tensor(name) != from.head)
+			outputs.push_back(name);
+	const std::vector<const char*> &inputs = to.runner->input_names();
+	if (inputs.size() != outputs.size()) {
+		std::cerr << "Segment '" << to.key << "' takes " << inputs.size() << " inputs, '" << from.key << "' gives " << outputs.size() << "." << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		const char *output = outputs[i];
+		for (const char *name : outputs)
+			if (!strcmp(name, inputs[i])) output = name;
+		const TfLiteTensor *out = from.runner->output_tensor(output), *in = to.runner->input_tensor(inputs[i]);
+		if (out->bytes != in->bytes || out->type != in->type || out->params.scale != in->params.scale || out->params.zero_point != in->params.zero_point) {
+			std::cerr << "Output '" << output << "' of segment '" << from.key << "' doesn't match input '" << inputs[i] << "' of '" << to.key << "'." << std::endl;
+			return false;
+		}
+
+		// Shared memory: the next segment reads the activations where the previous one wrote them
+		links_.emplace_back(out->bytes);
+		TfLiteCustomAllocation allocation = {links_.back().data(), out->bytes};
+		if (!links_.back()
+			|| from.runner->SetCustomAllocationForOutputTensor(output, allocation) != kTfLiteOk
+			|| to.runner->SetCustomAllocationForInputTensor(inputs[i], allocation) != kTfLiteOk) {
+			std::cerr << "Failed to link segment '" << from.key << "' to '" << to.key << "'." << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<float> EarlyExit::run (const uint8_t *image)
+{
+	const Clock::time_point start = Clock::now();
+	ScopedStage stage(PipelineMetrics::Invoke);
+	if (input_type_ == kTfLiteFloat32)
+		convertInputU8ToF32(image, reinterpret_cast<float*>(image_.data()), image_.size() / sizeof(float));
+	else
+		std::memcpy(image_.data(), image, image_.size());
+
+	// Some early exits go on to the end, to check them against the last head
+	const bool checking = options_.check_every > 0 && frames_++ % options_.check_every == 0;
+	std::vector<float> confidences;
+	int exit = -1;
+	double exit_ms = 0;
+	for (size_t i = 0; i < segments_.size(); ++i) {
+		Segment &segment = segments_[i];
+		if (segment.runner->Invoke() != kTfLiteOk) {
+			std::cerr << "Failed to invoke segment '" << segment.key << "'." << std::endl;
+			return std::vector<float>();
+		}
+		if (!segment.head || (exit >= 0 && i + 1 < segments_.size())) continue;
+
+		std::vector<float> head = dequantizeTensor(segment.head);
+		const size_t best = std::max_element(head.begin(), head.end()) - head.begin();
+		if (exit >= 0) { // last head of a checked early exit
+			std::vector<float>::const_iterator early = std::max_element(confidences.begin(), confidences.end());
+			std::lock_guard<std::mutex> lock(mutex_);
+			++checks_;
+			disagreements_ += size_t(early - confidences.begin()) != best;
+			break;
+		}
+		if (i + 1 == segments_.size() || (best < thresholds_.size() && head[best] >= thresholds_[best])) {
+			exit = i;
+			exit_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			confidences = std::move(head);
+			if (!checking) break;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++segments_[exit].exits;
+	segments_[exit].ms += exit_ms;
+	return confidences;
+}
+
+std::string EarlyExit::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	uint64_t frames = 0;
+	double ms = 0;
+	for (const Segment &segment : segments_) {
+		frames += segment.exits;
+		ms += segment.ms;
+	}
+	std::ostringstream json;
+	json
+		<< "{\"frames\":" << frames
+		<< ",\"mean_ms\":" << (frames ? ms / frames : 0)
+		<< ",\"exits\":[";
+	bool first = true;
+	for (const Segment &segment : segments_) {
+		if (!segment.head) continue;
+		json
+			<< (first ? "" : ",") << "{\"segment\":\"" << segment.key << "\""
+			<< ",\"frames\":" << segment.exits
+			<< ",\"fraction\":" << (frames ? double(segment.exits) / frames : 0)
+			<< ",\"mean_ms\":" << (segment.exits ? segment.ms / segment.exits : 0) << "}";
+		first = false;
+	}
+	json
+		<< "],\"checks\":{\"count\":" << checks_
+		<< ",\"disagreements\":" << disagreements_ << "}}";
+	return json.str();
+}
@@ -0,0 +1,72 @@
+#ifndef EARLY_EXIT_H
+#define EARLY_EXIT_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/signature_runner.h"
+
+#include "LockedMemory.h"
+
+// Early-exit inference of multi-exit models (ModelOptions::early_exit)
+struct EarlyExitOptions
+{
+	bool        enabled        = false;
+	std::string segment_prefix = "segment"; // signatures segment0, segment1... in graph order
+	float       threshold      = 0.9f;      // confidence for exiting on any class...
+	std::vector<std::pair<std::string, float>> class_thresholds; // ...unless overridden by label
+	int         check_every    = 50;        // early exits run to the end to check them (0: never)
+};
+
+// Parses per-class thresholds such as "everything_else=0.8,pizza_shovel=0.97"
+bool parseClassThresholds (const std::string &text, std::vector<std::pair<std::string, float>> &thresholds);
+
+// Runs a model exported as a chain of segments, each a signature whose outputs feed the next one.
+// Intermediate segments may have a classifier head (a [1, N] output over the labels): the chain
+// stops at the first head confident enough for the class it predicts, so that easy frames only
+// pay for the shallow layers and hard ones still go through the whole network.
+class EarlyExit
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	bool init (tflite::Interpreter &interpreter, const EarlyExitOptions &options, const std::vector<std::string> &class_labels,
+	           int width, int height, int channels, TfLiteType input_type);
+
+	// Returns the class confidences of the head the image exited at, empty on failure
+	std::vector<float> run (const uint8_t *image);
+
+	std::string toJson () const;
+
+private:
+	struct Segment
+	{
+		tflite::SignatureRunner *runner = nullptr;
+		std::string key;
+		const TfLiteTensor *head = nullptr; // classifier output, if any
+		// Statistics
+		uint64_t exits = 0;
+		double   ms    = 0;                  // total latency of the frames exiting here
+	};
+
+	EarlyExitOptions options_;
+	std::vector<Segment> segments_;
+	std::vector<float> thresholds_;          // by class
+	TfLiteType input_type_ = kTfLiteNoType;
+	LockedBuffer image_;                     // bound to the first segment's input
+	std::vector<LockedBuffer> links_;        // outputs of a segment bound to the inputs of the next
+	uint64_t frames_ = 0;
+
+	mutable std::mutex mutex_; // protects the statistics
+	uint64_t checks_ = 0;
+	uint64_t disagreements_ = 0; // early exits predicting another class than the last head
+
+	bool link (Segment &from, Segment &to);
+};
+
+#endif // EARLY_EXIT_H
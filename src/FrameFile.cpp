@@ -0,0 +1,58 @@
+#include "FrameFile.h"
+#include <sstream>
+#include <string>
+
+static const char *const kMagic = "raspizza-frame-1";
+static const char *const kFormats[] = {"nv12", "bgr", "bayer16", "bayer10p"};
+static const char *const kOrders[]  = {"rggb", "grbg", "gbrg", "bggr"};
+
+static size_t frameBytes (FrameFormat format, int stride, int height)
+{
+	return size_t(stride) * (format == FrameFormat::NV12 ? height + height / 2 : height);
+}
+
+template <typename Enum, size_t N>
+static bool parseName (const std::string &name, const char *const (&names)[N], Enum &value)
+{
+	for (size_t i = 0; i < N; ++i)
+		if (name == names[i]) {
+			value = Enum(i);
+			return true;
+		}
+	return false;
+}
+
+bool writeFrame (std::ostream &out, const CameraFrame &frame)
+{
+	const RawInfo &raw = frame.raw;
+	const std::streamsize precision = out.precision(9); // gains read back exactly
+	out << kMagic << " " << kFormats[int(frame.format)] << " " << frame.width << " " << frame.height << " " << frame.stride
+		<< " " << frame.sequence << " " << kOrders[int(raw.order)] << " " << raw.bit_depth << " " << raw.black_level
+		<< " " << raw.gains[0] << " " << raw.gains[1] << " " << raw.gains[2] << "\n";
+	out.precision(precision);
+	out.write(reinterpret_cast<const char*>(frame.data.data()), frameBytes(frame.format, frame.stride, frame.height));
+	return bool(out);
+}
+
+bool readFrame (std::istream &in, CameraFrame &frame)
+{
+	std::string line;
+	if (!std::getline(in, line)) return false;
+
+	std::istringstream header(line);
+	std::string magic, format, order;
+	RawInfo &raw = frame.raw;
+	header >> magic >> format >> frame.width >> frame.height >> frame.stride >> frame.sequence
+		>> order >> raw.bit_depth >> raw.black_level >> raw.gains[0] >> raw.gains[1] >> raw.gains[2];
+	if (!header || magic != kMagic || !parseName(format, kFormats, frame.format) || !parseName(order, kOrders, raw.order)
+		|| frame.width <= 0 || frame.height <= 0 || frame.stride <= 0) {
+		std::cerr << "Invalid frame header: " << line.substr(0, 80) << std::endl;
+		return false;
+	}
+	frame.data.resize(frameBytes(frame.format, frame.stride, frame.height));
+	if (!in.read(reinterpret_cast<char*>(frame.data.data()), frame.data.size())) {
+		std::cerr << "Truncated frame " << frame.sequence << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,18 @@
+#ifndef FRAME_FILE_H
+#define FRAME_FILE_H
+
+#include <iostream>
+
+#include "CameraFrame.h"
+
+// Recorded camera frames, to replay captures (NV12, MJPEG-decoded or raw Bayer) offline through
+// the pipeline. A file is a sequence of frames, each a text header line followed by its pixels:
+//
+//   raspizza-frame-1 <format> <width> <height> <stride> <sequence> <bayer order> <bit depth> <black level> <gain R> <gain G> <gain B>
+
+// Appends a frame
+bool writeFrame (std::ostream &out, const CameraFrame &frame);
+// Reads the next frame; false at the end of the file or if it isn't a frame file
+bool readFrame  (std::istream &in, CameraFrame &frame);
+
+#endif // FRAME_FILE_H
@@ -0,0 +1,109 @@
+#include "FramePipeline.h"
+#include <algorithm>
+#include <iostream>
+
+#include "PipelineMetrics.h"
+
+FramePipeline::FramePipeline (ModelInterpreter &interpreter, WorkerPool *workers) :
+	interpreter_(interpreter),
+	workers_(workers)
+{
+}
+
+bool FramePipeline::process (const CameraFrame &frame, FrameResult &result)
+{
+	PreparedInput input;
+	return preprocess(frame, input) && infer(input, result);
+}
+
+bool FramePipeline::preprocess (const FrameView &frame, PreparedInput &input)
+{
+	if (isBayer(frame.format) && frame.raw.bit_depth > 12) {
+		std::cerr << "Unsupported raw bit depth: " << frame.raw.bit_depth << std::endl;
+		return false;
+	}
+
+	// The model input is written straight into a pooled buffer, which inference binds without copy
+	input.buffer = interpreter_.acquireInputBuffer();
+	input.sequence = frame.sequence;
+	if (!input.buffer) {
+		std::cerr << "Failed to allocate an input buffer." << std::endl;
+		return false;
+	}
+
+	// Conversion, resize at the model input and BGR→RGB in a single pass: the full-resolution
+	// frame is read once and never converted as a whole
+	ScopedStage stage(PipelineMetrics::Preprocess);
+	const int width = interpreter_.getInputWidth(), height = interpreter_.getInputHeight();
+	uint8_t *rgb = input.buffer->data();
+	if (isBayer(frame.format))
+		return preprocessRaw(frame, rgb, width, height);
+	if (!resize_map_.matches(frame.width, frame.height, width, height))
+		makeResizeMap(resize_map_, frame.width, frame.height, width, height);
+
+	// Bands of output rows: each reads its own source rows once, while they are in the core's cache
+	const uint8_t *uv_plane = frame.data + frame.stride * frame.height;
+	runBands(height, [&] (int row_begin, int row_end) {
+		if (frame.format == FrameFormat::NV12)
+			nv12ToRGBResize(frame.data, uv_plane, frame.stride, rgb, resize_map_, row_begin, row_end);
+		else
+			bgrToRGBResize(frame.data, frame.stride, rgb, resize_map_, row_begin, row_end);
+	});
+	return true;
+}
+
+bool FramePipeline::preprocessRaw (const FrameView &frame, uint8_t *rgb, int width, int height)
+{
+	// Largest superpixel still at least the model input, so the resize never has to upscale
+	// (nor skip source pixels by downscaling more than 2×)
+	const int bin = frame.width / 4 >= width && frame.height / 4 >= height ? 4 : 2;
+	const int binned_width = frame.width / bin, binned_height = frame.height / bin;
+	if (!tone_map_.matches(frame.raw))
+		makeRawToneMap(tone_map_, frame.raw);
+
+	// Binned straight into the model input when the sizes match, through a small RGB image otherwise
+	if (binned_width == width && binned_height == height) {
+		runBands(height, [&] (int row_begin, int row_end) {
+			bayerToRGBBinned(frame.data, frame.format, frame.width, frame.stride, bin, tone_map_, rgb, row_begin, row_end);
+		});
+		return true;
+	}
+	binned_.resize(binned_width * binned_height * 3);
+	runBands(binned_height, [&] (int row_begin, int row_end) {
+		bayerToRGBBinned(frame.data, frame.format, frame.width, frame.stride, bin, tone_map_, binned_.data(), row_begin, row_end);
+	});
+	if (!resize_map_.matches(binned_width, binned_height, width, height))
+		makeResizeMap(resize_map_, binned_width, binned_height, width, height);
+	runBands(height, [&] (int row_begin, int row_end) {
+		rgbResize(binned_.data(), binned_width * 3, rgb, resize_map_, row_begin, row_end);
+	});
+	return true;
+}
+
+void FramePipeline::runBands (int rows, const std::function<void(int, int)> &band)
+{
+	if (!workers_) {
+		band(0, rows);
+		return;
+	}
+	const int bands = std::min<int>(rows, 2 * workers_->concurrency()); // some slack for uneven cores
+	workers_->parallelFor(bands, [&] (int b) {
+		band(rows * b / bands, rows * (b + 1) / bands);
+	});
+}
+
+bool FramePipeline::infer (const PreparedInput &input, FrameResult &result)
+{
+	// Perform inference, remotely if possible
+	if (!offload_ || !offload_->infer(input.buffer->data(), input.buffer->size(), result.detections))
+		result.detections = interpreter_.runInference(input.buffer->data());
+	result.class_id = -1;
+	result.confidence = 0;
+	for (const Detection &detection : result.detections) {
+		if (result.class_id < 0 || detection.confidence > result.confidence) {
+			result.class_id = detection.class_id;
+			result.confidence = detection.confidence;
+		}
+	}
+	return result.class_id >= 0;
+}
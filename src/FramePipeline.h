@@ -0,0 +1,59 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <functional>
+#include <vector>
+
+#include "CameraFrame.h"
+#include "Kernels.h"
+#include "ModelInterpreter.h"
+#include "Offload.h"
+#include "WorkerPool.h"
+
+// Classification of a frame
+struct FrameResult
+{
+	std::vector<Detection> detections;
+	int   class_id   = -1; // most confident class
+	float confidence = 0;
+};
+
+// Preprocessed frame, ready to be bound to the model input
+struct PreparedInput
+{
+	std::shared_ptr<LockedBuffer> buffer; // from ModelInterpreter::acquireInputBuffer()
+	uint32_t sequence = 0;
+};
+
+// Production path from a camera frame to its classification: conversion, preprocessing and inference.
+// A pipeline isn't thread-safe: concurrent streams need one pipeline (and one interpreter) each.
+// process() does it all at once; preprocess() and infer() split it so that the next frames can
+// be preprocessed (by another pipeline sharing the interpreter) while one is being inferred.
+class FramePipeline
+{
+public:
+	// workers: if given, preprocessing is split into bands of output rows run in parallel
+	explicit FramePipeline (ModelInterpreter &interpreter, WorkerPool *workers = nullptr);
+
+	bool process    (const CameraFrame &frame, FrameResult &result);
+	bool preprocess (const CameraFrame &frame, PreparedInput &input) {return preprocess(frame.view(), input);}
+	bool preprocess (const FrameView &frame, PreparedInput &input);
+	bool infer      (const PreparedInput &input, FrameResult &result);
+
+	// Infers on a companion host when it answers within its budget, locally otherwise
+	void setOffload (OffloadClient *offload) {offload_ = offload;}
+
+private:
+	ModelInterpreter &interpreter_;
+	WorkerPool *const workers_;
+	OffloadClient *offload_ = nullptr;
+	ResizeMap resize_map_; // for the last frame size
+	RawToneMap tone_map_;  // for the last raw levels and gains
+	std::vector<uint8_t> binned_; // demosaiced raw frame, when it still needs a resize
+
+	bool preprocessRaw (const FrameView &frame, uint8_t *rgb, int width, int height);
+	// Splits rows into bands run on the workers (with the caller), or runs them all at once
+	void runBands (int rows, const std::function<void(int, int)> &band);
+};
+
+#endif // FRAME_PIPELINE_H
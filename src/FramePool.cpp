@@ -0,0 +1,29 @@
+#include "FramePool.h"
+
+FramePool::FramePool () :
+	free_(std::make_shared<FreeList>())
+{
+}
+
+std::shared_ptr<CameraFrame> FramePool::acquire ()
+{
+	std::unique_ptr<CameraFrame> frame;
+	{
+		std::lock_guard<std::mutex> lock(free_->mutex);
+		if (!free_->frames.empty()) {
+			frame = std::move(free_->frames.back());
+			free_->frames.pop_back();
+		}
+	}
+	if (!frame) frame = std::make_unique<CameraFrame>();
+
+	std::weak_ptr<FreeList> pool = free_;
+	return std::shared_ptr<CameraFrame>(frame.release(), [pool] (CameraFrame *released) {
+		if (std::shared_ptr<FreeList> list = pool.lock()) {
+			std::lock_guard<std::mutex> lock(list->mutex);
+			list->frames.emplace_back(released);
+		} else {
+			delete released;
+		}
+	});
+}
@@ -0,0 +1,28 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CameraFrame.h"
+
+// Recycles CameraFrames, so that their (locked, pre-faulted) buffers are allocated only once.
+// Frames go back to the pool when their last reference is dropped, even after the pool is gone.
+class FramePool
+{
+public:
+	FramePool ();
+
+	std::shared_ptr<CameraFrame> acquire ();
+
+private:
+	struct FreeList
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<CameraFrame>> frames;
+	};
+	std::shared_ptr<FreeList> free_;
+};
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,154 @@
+#include "IdleMonitor.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+bool parseOpenHours (const std::string &text, std::vector<std::pair<int, int>> &open_hours)
+{
+	open_hours.clear();
+	std::stringstream stream(text);
+	for (std::string range; std::getline(stream, range, ','); ) {
+		int begin_h, begin_m, end_h, end_m;
+		if (sscanf(range.c_str(), "%d:%d-%d:%d", &begin_h, &begin_m, &end_h, &end_m) != 4
+			|| begin_h < 0 || begin_h > 24 || end_h < 0 || end_h > 24 || begin_m < 0 || begin_m > 59 || end_m < 0 || end_m > 59)
+			return false;
+		open_hours.emplace_back(begin_h * 60 + begin_m, end_h * 60 + end_m);
+	}
+	return !open_hours.empty();
+}
+
+// Raw level of a Bayer pixel
+static int rawLevel (const uint8_t *row, FrameFormat format, int x)
+{
+	if (format == FrameFormat::Bayer16)
+		return row[2 * x] | row[2 * x + 1] << 8;
+	const uint8_t *group = row + x / 4 * 5; // Bayer10P
+	return group[x % 4] << 2 | (group[4] >> (2 * (x % 4)) & 3);
+}
+
+// Mean luma over a sparse grid: a few hundred loads, negligible next to the frame copy.
+// Raw frames are sampled at green sites, tone-mapped like their demosaiced image.
+static float meanLuma (const CameraFrame &frame, RawToneMap &tone_map)
+{
+	const int step = 16; // even, so that the samples stay on the same Bayer position
+	int green_x = 0;
+	if (isBayer(frame.format)) {
+		if (!tone_map.matches(frame.raw))
+			makeRawToneMap(tone_map, frame.raw);
+		green_x = frame.raw.order == BayerOrder::RGGB || frame.raw.order == BayerOrder::BGGR; // on even rows
+	}
+	const int max_level = isBayer(frame.format) ? int(tone_map.lut[1].size()) - 1 : 0;
+	uint64_t sum = 0, count = 0;
+	for (int y = step / 2; y < frame.height; y += step) {
+		const uint8_t *row = frame.data.data() + y * frame.stride;
+		for (int x = step / 2; x < frame.width; x += step) {
+			if (frame.format == FrameFormat::NV12) {
+				sum += row[x];
+			} else if (frame.format == FrameFormat::BGR) { // Rec. 601 weights
+				const uint8_t *p = row + 3 * x;
+				sum += (29 * p[0] + 150 * p[1] + 77 * p[2]) >> 8;
+			} else {
+				sum += tone_map.lut[1][std::min(rawLevel(row, frame.format, x + green_x), max_level)];
+			}
+			++count;
+		}
+	}
+	return count ? float(sum) / count : 0;
+}
+
+IdleMonitor::IdleMonitor (const IdleOptions &options) :
+	options_(options),
+	idle_(false),
+	reason_("start"),
+	brightness_(0),
+	reference_(0),
+	quiet_(false),
+	idle_seconds_(0),
+	active_seconds_(0),
+	idle_entries_(0),
+	wake_ups_(0)
+{
+}
+
+bool IdleMonitor::isOpen (std::time_t wall_time) const
+{
+	if (options_.open_hours.empty()) return true;
+	std::tm local;
+	localtime_r(&wall_time, &local);
+	int minute = local.tm_hour * 60 + local.tm_min;
+	for (const auto &range : options_.open_hours) {
+		bool inside = range.first <= range.second
+			? minute >= range.first && minute < range.second
+			: minute >= range.first || minute < range.second; // past midnight
+		if (inside) return true;
+	}
+	return false;
+}
+
+bool IdleMonitor::update (const CameraFrame &frame, Clock::time_point now, std::time_t wall_time)
+{
+	// Lux from the ISP when available, otherwise the luma of the (auto-exposed) frame
+	const bool has_lux = frame.lux >= 0;
+	const float brightness = has_lux ? frame.lux : meanLuma(frame, tone_map_);
+	const bool dark = brightness < (has_lux ? options_.dark_lux : options_.dark_luma);
+	const bool open = isOpen(wall_time);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (last_update_ != Clock::time_point())
+		(idle_ ? idle_seconds_ : active_seconds_) += std::chrono::duration<double>(now - last_update_).count();
+	last_update_ = now;
+	brightness_ = brightness;
+
+	if (idle_) {
+		// The reference is floored, so that noise in a pitch-dark scene doesn't count as a change
+		const float reference = std::max(reference_, (has_lux ? options_.dark_lux : options_.dark_luma) / 4);
+		const bool changed = brightness > reference * options_.wake_ratio || brightness * options_.wake_ratio < reference;
+		if ((open && !dark) || changed) {
+			idle_ = false;
+			quiet_ = false;
+			reason_ = changed ? "brightness" : "opening";
+			awake_until_ = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.wake_hold_seconds));
+			++wake_ups_;
+		}
+		return idle_;
+	}
+
+	if ((open && !dark) || now < awake_until_) {
+		quiet_ = false;
+		return false;
+	}
+	if (!quiet_) {
+		quiet_ = true;
+		quiet_since_ = now;
+	}
+	if (std::chrono::duration<double>(now - quiet_since_).count() >= options_.enter_seconds) {
+		idle_ = true;
+		reason_ = open ? "dark" : "closed";
+		reference_ = brightness;
+		++idle_entries_;
+	}
+	return idle_;
+}
+
+bool IdleMonitor::idle () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return idle_;
+}
+
+std::string IdleMonitor::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::ostringstream json;
+	json
+		<< "{\"idle\":" << (idle_ ? "true" : "false")
+		<< ",\"reason\":\"" << reason_ << "\""
+		<< ",\"brightness\":" << brightness_
+		<< ",\"idle_reference\":" << reference_
+		<< ",\"idle_seconds\":" << idle_seconds_
+		<< ",\"active_seconds\":" << active_seconds_
+		<< ",\"idle_entries\":" << idle_entries_
+		<< ",\"wake_ups\":" << wake_ups_
+		<< "}";
+	return json.str();
+}
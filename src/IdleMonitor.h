@@ -0,0 +1,63 @@
+#ifndef IDLE_MONITOR_H
+#define IDLE_MONITOR_H
+
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CameraFrame.h"
+#include "Kernels.h"
+
+struct IdleOptions
+{
+	float  dark_lux          = 10;   // darker scenes count as a closed shop (with Lux metadata)
+	float  dark_luma         = 24;   // same on the mean luma, for cameras without Lux metadata
+	float  wake_ratio        = 2;    // brightness change from the idle reference that wakes up
+	double enter_seconds     = 60;   // continuous darkness or closed hours before going idle
+	double wake_hold_seconds = 300;  // stay awake this long after a brightness wake-up
+	std::vector<std::pair<int, int>> open_hours; // [begin, end) in minutes after local midnight, empty: always open
+};
+
+// Parses opening hours such as "11:00-14:30,18:00-23:30" (ranges may wrap past midnight)
+bool parseOpenHours (const std::string &text, std::vector<std::pair<int, int>> &open_hours);
+
+// Decides when the oven area is dark or out of opening hours, so that the camera can drop to its
+// minimum frame rate and inference can be suspended; any large brightness change wakes it up.
+class IdleMonitor
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit IdleMonitor (const IdleOptions &options = IdleOptions());
+
+	// Returns true while idle: the frame shouldn't be converted nor classified
+	bool update (const CameraFrame &frame, Clock::time_point now = Clock::now(), std::time_t wall_time = std::time(nullptr));
+	bool idle () const;
+
+	std::string toJson () const;
+
+private:
+	IdleOptions const options_;
+
+	mutable std::mutex mutex_;
+	bool idle_;
+	const char *reason_;       // why the monitor is idle, or last woke up
+	float brightness_;         // last measured, Lux or mean luma
+	float reference_;          // brightness when going idle
+	Clock::time_point quiet_since_;
+	Clock::time_point awake_until_;
+	Clock::time_point last_update_;
+	bool quiet_;
+	double idle_seconds_;
+	double active_seconds_;
+	uint64_t idle_entries_;
+	uint64_t wake_ups_;
+	RawToneMap tone_map_;      // luma of raw frames, used by update() only
+
+	bool isOpen (std::time_t wall_time) const;
+};
+
+#endif // IDLE_MONITOR_H
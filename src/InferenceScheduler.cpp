@@ -0,0 +1,194 @@
+#include "InferenceScheduler.h"
+#include <algorithm>
+#include <sstream>
+
+#include "Tracer.h"
+
+static int bucket (uint64_t ns)
+{
+	int bucket = 0;
+	for (uint64_t us = ns / 1000; us && bucket < 31; us >>= 1)
+		++bucket;
+	return bucket;
+}
+
+// Upper bound of the bucket holding the p-th percentile, in microseconds
+template <size_t N>
+static double percentile (const std::array<uint64_t, N> &histogram, double p)
+{
+	uint64_t count = 0;
+	for (uint64_t n : histogram) count += n;
+	if (!count) return 0;
+	uint64_t rank = std::max<uint64_t>(1, uint64_t(p * count + 0.5)), seen = 0;
+	for (size_t b = 0; b < N; ++b) {
+		seen += histogram[b];
+		if (seen >= rank) return double(1ull << b);
+	}
+	return 0;
+}
+
+InferenceScheduler::InferenceScheduler (unsigned threads) :
+	threads_count_(std::max(1u, threads))
+{
+	for (unsigned i = 0; i < threads_count_; ++i)
+		threads_.emplace_back(&InferenceScheduler::threadLoop, this);
+}
+
+InferenceScheduler::~InferenceScheduler ()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	job_ready_.notify_all();
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+int InferenceScheduler::addLane (Infer infer, const LaneOptions &options)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	lanes_.push_back(std::unique_ptr<Lane>(new Lane{std::move(infer), options, {}, false}));
+	top_priority_ = lanes_.size() == 1 ? options.priority : std::max(top_priority_, options.priority);
+	stats_[options.priority]; // reported even before the first job
+	return lanes_.size() - 1;
+}
+
+void InferenceScheduler::submit (int lane_index, PreparedInput &&input, Callback done)
+{
+	std::vector<Job> dropped;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		Lane &lane = *lanes_.at(lane_index);
+		const Clock::time_point now = Clock::now();
+		lane.queue.push_back(Job{std::move(input), std::move(done), now, now + lane.options.deadline});
+		while (lane.queue.size() > std::max<size_t>(1, lane.options.max_queued)) {
+			dropped.push_back(std::move(lane.queue.front()));
+			lane.queue.pop_front();
+			++stats_[lane.options.priority].dropped;
+		}
+	}
+	job_ready_.notify_one();
+	for (Job &job : dropped)
+		job.done(FrameResult(), false);
+}
+
+void InferenceScheduler::drop (Lane &lane, std::vector<Job> &dropped)
+{
+	dropped.push_back(std::move(lane.queue.front()));
+	lane.queue.pop_front();
+	++stats_[lane.options.priority].dropped;
+}
+
+int InferenceScheduler::pickLane (Clock::time_point now, std::vector<Job> &dropped)
+{
+	// One thread stays free for the top priority, unless there is only one
+	const bool below_top_allowed = threads_count_ == 1 || running_below_top_ < threads_count_ - 1;
+	int best = -1;
+	for (size_t i = 0; i < lanes_.size(); ++i) {
+		Lane &lane = *lanes_[i];
+		if (lane.options.drop_expired)
+			while (!lane.queue.empty() && lane.queue.front().deadline < now)
+				drop(lane, dropped);
+		if (lane.busy || lane.queue.empty()) continue;
+		if (lane.options.priority < top_priority_ && !below_top_allowed) continue;
+		if (best < 0) {
+			best = i;
+			continue;
+		}
+		const Lane &current = *lanes_[best];
+		if (lane.options.priority > current.options.priority
+			|| (lane.options.priority == current.options.priority && lane.queue.front().deadline < current.queue.front().deadline))
+			best = i;
+	}
+	return best;
+}
+
+void InferenceScheduler::threadLoop ()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		std::vector<Job> dropped;
+		int index = -1;
+		if (stop_) {
+			for (auto &lane : lanes_)
+				while (!lane->queue.empty())
+					drop(*lane, dropped);
+		} else {
+			index = pickLane(Clock::now(), dropped);
+		}
+		if (!dropped.empty()) { // callbacks without the lock
+			lock.unlock();
+			for (Job &job : dropped)
+				job.done(FrameResult(), false);
+			lock.lock();
+			continue;
+		}
+		if (index < 0) {
+			if (stop_) return;
+			job_ready_.wait(lock);
+			continue;
+		}
+
+		Lane &lane = *lanes_[index];
+		Job job = std::move(lane.queue.front());
+		lane.queue.pop_front();
+		lane.busy = true;
+		const bool below_top = lane.options.priority < top_priority_;
+		if (below_top) ++running_below_top_;
+		lock.unlock();
+
+		const Clock::time_point dispatched = Clock::now();
+		Tracer::setFrame(job.input.sequence); // the trace events of this thread belong to the job's frame
+		FrameResult result;
+		lane.infer(job.input, result);
+		const Clock::time_point finished = Clock::now();
+		job.done(result, true);
+
+		lock.lock();
+		lane.busy = false;
+		if (below_top) --running_below_top_;
+		PriorityStats &stats = stats_[lane.options.priority];
+		const uint64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(finished - job.submitted).count();
+		++stats.completed;
+		stats.late += finished > job.deadline;
+		stats.max_ns = std::max(stats.max_ns, latency_ns);
+		++stats.latency[bucket(latency_ns)];
+		++stats.wait[bucket(std::chrono::duration_cast<std::chrono::nanoseconds>(dispatched - job.submitted).count())];
+		job_ready_.notify_all(); // the lane (and maybe a reserved thread) is free again
+	}
+}
+
+std::string InferenceScheduler::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::ostringstream json;
+	json << "{\"threads\":" << threads_count_ << ",\"lanes\":[";
+	for (size_t i = 0; i < lanes_.size(); ++i) {
+		const Lane &lane = *lanes_[i];
+		json
+			<< (i ? "," : "") << "{\"name\":\"" << lane.options.name << "\""
+			<< ",\"priority\":" << lane.options.priority
+			<< ",\"deadline_ms\":" << lane.options.deadline.count()
+			<< ",\"queued\":" << lane.queue.size()
+			<< ",\"busy\":" << (lane.busy ? "true" : "false") << "}";
+	}
+	json << "],\"priorities\":{";
+	bool first = true;
+	for (auto it = stats_.rbegin(); it != stats_.rend(); ++it) { // most urgent first
+		const PriorityStats &stats = it->second;
+		json
+			<< (first ? "\"" : ",\"") << it->first << "\":{"
+			<< "\"completed\":" << stats.completed
+			<< ",\"dropped\":" << stats.dropped
+			<< ",\"late\":" << stats.late
+			<< ",\"p50_us\":" << percentile(stats.latency, 0.50)
+			<< ",\"p99_us\":" << percentile(stats.latency, 0.99)
+			<< ",\"max_us\":" << stats.max_ns / 1e3
+			<< ",\"wait_p50_us\":" << percentile(stats.wait, 0.50)
+			<< ",\"wait_p99_us\":" << percentile(stats.wait, 0.99) << "}";
+		first = false;
+	}
+	json << "}}";
+	return json.str();
+}
@@ -0,0 +1,101 @@
+#ifndef INFERENCE_SCHEDULER_H
+#define INFERENCE_SCHEDULER_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FramePipeline.h"
+
+// Scheduling parameters of a lane: the jobs of one model (or stream), which share a priority
+// and a deadline
+struct LaneOptions
+{
+	std::string name;
+	int  priority     = 0;                     // higher is more urgent
+	std::chrono::milliseconds deadline {1000}; // from submission
+	bool drop_expired = true;                  // expired jobs are dropped instead of run late
+	size_t max_queued = 4;                     // the oldest jobs are dropped past it
+};
+
+// Runs inference jobs of several lanes on a few threads, most urgent first: the highest priority,
+// then the earliest deadline. A lane's jobs run one at a time (its pipeline and interpreter aren't
+// thread-safe), lanes run concurrently. Inference can't be preempted, so with more than one thread
+// the last one is kept for the top-priority lanes: a backlog of lower-priority work never holds
+// all the threads when an urgent job comes in. Latencies are reported per priority.
+class InferenceScheduler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	// Called on a scheduler thread with the result; ran is false if the job was dropped
+	using Callback = std::function<void(const FrameResult &result, bool ran)>;
+	// Infers a job on a scheduler thread, as FramePipeline::infer()
+	using Infer = std::function<bool(const PreparedInput &input, FrameResult &result)>;
+
+	explicit InferenceScheduler (unsigned threads = 1);
+	~InferenceScheduler (); // drops the jobs still queued
+
+	// infer: runs the lane's jobs, one at a time. Lanes are added before submitting.
+	int  addLane (Infer infer, const LaneOptions &options);
+	// pipeline: infers the lane's jobs (only infer() is called)
+	int  addLane (FramePipeline &pipeline, const LaneOptions &options)
+		{return addLane([&pipeline] (const PreparedInput &input, FrameResult &result) {return pipeline.infer(input, result);}, options);}
+	void submit  (int lane, PreparedInput &&input, Callback done);
+
+	std::string toJson () const;
+
+private:
+	struct Job
+	{
+		PreparedInput input;
+		Callback done;
+		Clock::time_point submitted;
+		Clock::time_point deadline;
+	};
+
+	struct Lane
+	{
+		Infer infer;
+		LaneOptions options;
+		std::deque<Job> queue;
+		bool busy = false;
+	};
+
+	// Latency histogram with power-of-two microsecond buckets, as PipelineMetrics
+	static constexpr int kBuckets = 32;
+	struct PriorityStats
+	{
+		uint64_t completed = 0;
+		uint64_t dropped   = 0;
+		uint64_t late      = 0; // completed past the deadline
+		uint64_t max_ns    = 0;
+		std::array<uint64_t, kBuckets> latency {}; // submission to result
+		std::array<uint64_t, kBuckets> wait {};    // submission to dispatch
+	};
+
+	unsigned const threads_count_;
+	std::vector<std::thread> threads_;
+
+	mutable std::mutex mutex_; // protects everything below
+	std::condition_variable job_ready_;
+	std::vector<std::unique_ptr<Lane>> lanes_;
+	int top_priority_ = 0;
+	unsigned running_below_top_ = 0; // threads running lower-priority jobs
+	std::map<int, PriorityStats> stats_;
+	bool stop_ = false;
+
+	void threadLoop ();
+	int  pickLane (Clock::time_point now, std::vector<Job> &dropped); // -1 if no job can run now
+	void drop (Lane &lane, std::vector<Job> &dropped);
+};
+
+#endif // INFERENCE_SCHEDULER_H
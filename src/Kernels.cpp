@@ -0,0 +1,260 @@
+#include "Kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+void convertInputU8ToF32 (const uint8_t *src, float *dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = static_cast<float>(src[i]);
+}
+
+void dequantizeU8 (const uint8_t *src, float *dst, size_t count, float scale, int zero_point)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = scale * (static_cast<int>(src[i]) - zero_point);
+}
+
+void dequantizeI8 (const int8_t *src, float *dst, size_t count, float scale, int zero_point)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = scale * (static_cast<int>(src[i]) - zero_point);
+}
+
+void streamCopy (const uint8_t *src, uint8_t *dst, size_t size)
+{
+	size_t i = 0;
+#ifdef __ARM_NEON
+	for (; i + 64 <= size; i += 64) {
+		__builtin_prefetch(src + i + 512);
+		uint8x16_t a = vld1q_u8(src + i), b = vld1q_u8(src + i + 16), c = vld1q_u8(src + i + 32), d = vld1q_u8(src + i + 48);
+		vst1q_u8(dst + i, a);
+		vst1q_u8(dst + i + 16, b);
+		vst1q_u8(dst + i + 32, c);
+		vst1q_u8(dst + i + 48, d);
+	}
+#endif
+	std::memcpy(dst + i, src + i, size - i);
+}
+
+// One axis of the resampling: source index and weight of index + 1 for each destination position
+static void resampleAxis (int src, int dst, std::vector<int32_t> &index, std::vector<uint16_t> &weight)
+{
+	index.resize(dst);
+	weight.resize(dst);
+	const double scale = double(src) / dst;
+	for (int d = 0; d < dst; ++d) {
+		double position = (d + 0.5) * scale - 0.5;
+		int i = int(std::floor(position));
+		double fraction = position - i;
+		if (i < 0) {
+			i = 0;
+			fraction = 0;
+		}
+		if (i >= src - 1) {
+			i = std::max(0, src - 2);
+			fraction = src > 1 ? 1 : 0;
+		}
+		index[d] = i;
+		weight[d] = uint16_t(std::lround(fraction * ResizeMap::kOne));
+	}
+}
+
+void makeResizeMap (ResizeMap &map, int src_width, int src_height, int dst_width, int dst_height)
+{
+	map.src_width  = src_width;
+	map.src_height = src_height;
+	map.dst_width  = dst_width;
+	map.dst_height = dst_height;
+	resampleAxis(src_width,  dst_width,  map.x, map.wx);
+	resampleAxis(src_height, dst_height, map.y, map.wy);
+	resampleAxis(src_width / 2,  dst_width,  map.cx, map.cwx);
+	resampleAxis(src_height / 2, dst_height, map.cy, map.cwy);
+}
+
+// Bilinear sample of 4 neighbours, weights in 1/kOne; the result is rounded to 8 bits
+static inline int lerp2D (int a, int b, int c, int d, int wx, int wy)
+{
+	const int one = ResizeMap::kOne;
+	int top    = a * (one - wx) + b * wx;
+	int bottom = c * (one - wx) + d * wx;
+	return (top * (one - wy) + bottom * wy + (1 << 21)) >> 22;
+}
+
+static inline uint8_t clamp8 (int value)
+{
+	return uint8_t(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+void nv12ToRGBResize (const uint8_t *y_plane, const uint8_t *uv_plane, int stride, uint8_t *rgb, const ResizeMap &map,
+                      int row_begin, int row_end)
+{
+	// BT.601 limited range, in 1/2^20 (as OpenCV)
+	const int CY = 1220542, CVR = 1673527, CVG = -852492, CUG = -409993, CUB = 2116026;
+	const int round = 1 << 19;
+
+	if (row_end < 0) row_end = map.dst_height;
+	for (int dy = row_begin; dy < row_end; ++dy) {
+		const uint8_t *y0 = y_plane + map.y[dy] * stride;
+		const uint8_t *y1 = y0 + (map.src_height > 1 ? stride : 0);
+		const uint8_t *c0 = uv_plane + map.cy[dy] * stride;
+		const uint8_t *c1 = c0 + (map.src_height > 3 ? stride : 0);
+		const int wy = map.wy[dy], cwy = map.cwy[dy];
+		uint8_t *out = rgb + dy * map.dst_width * 3;
+
+		for (int dx = 0; dx < map.dst_width; ++dx) {
+			const int x = map.x[dx], wx = map.wx[dx];
+			const int cx = 2 * map.cx[dx], cwx = map.cwx[dx];
+			int luma = lerp2D(y0[x], y0[x + 1], y1[x], y1[x + 1], wx, wy);
+			int u = lerp2D(c0[cx],     c0[cx + 2], c1[cx],     c1[cx + 2], cwx, cwy) - 128;
+			int v = lerp2D(c0[cx + 1], c0[cx + 3], c1[cx + 1], c1[cx + 3], cwx, cwy) - 128;
+			int y = std::max(0, luma - 16) * CY;
+			out[0] = clamp8((y + CVR * v + round) >> 20);
+			out[1] = clamp8((y + CVG * v + CUG * u + round) >> 20);
+			out[2] = clamp8((y + CUB * u + round) >> 20);
+			out += 3;
+		}
+	}
+}
+
+// Packed 3-channel resize, with or without swapping the first and last channels
+template <bool swap>
+static void packedResize (const uint8_t *src, int stride, uint8_t *dst, const ResizeMap &map, int row_begin, int row_end)
+{
+	if (row_end < 0) row_end = map.dst_height;
+	for (int dy = row_begin; dy < row_end; ++dy) {
+		const uint8_t *row0 = src + map.y[dy] * stride;
+		const uint8_t *row1 = row0 + (map.src_height > 1 ? stride : 0);
+		const int wy = map.wy[dy];
+		uint8_t *out = dst + dy * map.dst_width * 3;
+
+		for (int dx = 0; dx < map.dst_width; ++dx) {
+			const int x = 3 * map.x[dx], wx = map.wx[dx];
+			for (int c = 0; c < 3; ++c)
+				out[swap ? 2 - c : c] = uint8_t(lerp2D(row0[x + c], row0[x + 3 + c], row1[x + c], row1[x + 3 + c], wx, wy));
+			out += 3;
+		}
+	}
+}
+
+void bgrToRGBResize (const uint8_t *bgr, int stride, uint8_t *rgb, const ResizeMap &map, int row_begin, int row_end)
+{
+	packedResize<true>(bgr, stride, rgb, map, row_begin, row_end);
+}
+
+void rgbResize (const uint8_t *src, int stride, uint8_t *rgb, const ResizeMap &map, int row_begin, int row_end)
+{
+	packedResize<false>(src, stride, rgb, map, row_begin, row_end);
+}
+
+bool RawToneMap::matches (const RawInfo &raw) const
+{
+	return !lut[0].empty() && raw.bit_depth == info.bit_depth && raw.black_level == info.black_level
+		&& raw.gains[0] == info.gains[0] && raw.gains[1] == info.gains[1] && raw.gains[2] == info.gains[2];
+}
+
+void makeRawToneMap (RawToneMap &map, const RawInfo &raw)
+{
+	map.info = raw;
+	const int levels = 1 << raw.bit_depth;
+	const double range = std::max(1, levels - 1 - raw.black_level);
+	for (int c = 0; c < 3; ++c) {
+		map.lut[c].resize(levels);
+		for (int level = 0; level < levels; ++level) {
+			double linear = std::min(1.0, std::max(0, level - raw.black_level) * raw.gains[c] / range);
+			map.lut[c][level] = uint8_t(std::lround(255 * std::pow(linear, 1 / 2.2))); // display gamma, as the ISP output
+		}
+	}
+}
+
+// CSI-2 packed 10-bit row to one uint16 per pixel
+static void unpackRaw10 (const uint8_t *src, uint16_t *dst, int width)
+{
+	for (int x = 0; x + 3 < width; x += 4, src += 5, dst += 4) {
+		const uint8_t low = src[4];
+		dst[0] = uint16_t(src[0] << 2 | (low & 3));
+		dst[1] = uint16_t(src[1] << 2 | (low >> 2 & 3));
+		dst[2] = uint16_t(src[2] << 2 | (low >> 4 & 3));
+		dst[3] = uint16_t(src[3] << 2 | (low >> 6));
+	}
+}
+
+// Sums of the 4 pattern positions (top-left, top-right, bottom-left, bottom-right) of each
+// bin×bin superpixel of rows[0 .. bin), interleaved in sums
+static void binBayerRows (const uint16_t *const *rows, int bin, int out_width, uint16_t *sums)
+{
+	int x = 0;
+#ifdef __ARM_NEON
+	// 8 superpixels per iteration: the loads deinterleave the columns by pattern position
+	if (bin == 2) {
+		for (; x + 8 <= out_width; x += 8) {
+			uint16x8x2_t top = vld2q_u16(rows[0] + 2 * x), bottom = vld2q_u16(rows[1] + 2 * x);
+			uint16x8x4_t out = {{top.val[0], top.val[1], bottom.val[0], bottom.val[1]}};
+			vst4q_u16(sums + 4 * x, out);
+		}
+	} else {
+		for (; x + 8 <= out_width; x += 8) {
+			uint16x8x4_t r0 = vld4q_u16(rows[0] + 4 * x), r1 = vld4q_u16(rows[1] + 4 * x);
+			uint16x8x4_t r2 = vld4q_u16(rows[2] + 4 * x), r3 = vld4q_u16(rows[3] + 4 * x);
+			uint16x8x4_t out;
+			out.val[0] = vaddq_u16(vaddq_u16(r0.val[0], r0.val[2]), vaddq_u16(r2.val[0], r2.val[2]));
+			out.val[1] = vaddq_u16(vaddq_u16(r0.val[1], r0.val[3]), vaddq_u16(r2.val[1], r2.val[3]));
+			out.val[2] = vaddq_u16(vaddq_u16(r1.val[0], r1.val[2]), vaddq_u16(r3.val[0], r3.val[2]));
+			out.val[3] = vaddq_u16(vaddq_u16(r1.val[1], r1.val[3]), vaddq_u16(r3.val[1], r3.val[3]));
+			vst4q_u16(sums + 4 * x, out);
+		}
+	}
+#endif
+	for (; x < out_width; ++x) {
+		uint16_t *sum = sums + 4 * x;
+		sum[0] = sum[1] = sum[2] = sum[3] = 0;
+		for (int dy = 0; dy < bin; ++dy)
+			for (int dx = 0; dx < bin; ++dx)
+				sum[(dy & 1) * 2 + (dx & 1)] += rows[dy][bin * x + dx];
+	}
+}
+
+void bayerToRGBBinned (const uint8_t *raw, FrameFormat format, int width, int stride, int bin, const RawToneMap &map,
+                       uint8_t *rgb, int row_begin, int row_end)
+{
+	const int out_width = width / bin;
+	const int shift = bin == 4 ? 2 : 0; // sums of bin²/4 same-color pixels back to one level
+	const int max_level = int(map.lut[0].size()) - 1;
+
+	// Pattern positions of red, green (twice) and blue
+	int r = 0, g0 = 1, g1 = 2, b = 3;
+	switch (map.info.order) {
+	case BayerOrder::RGGB: break;
+	case BayerOrder::GRBG: r = 1; g0 = 0; g1 = 3; b = 2; break;
+	case BayerOrder::GBRG: r = 2; g0 = 0; g1 = 3; b = 1; break;
+	case BayerOrder::BGGR: r = 3; b = 0; break;
+	}
+
+	std::vector<uint16_t> unpacked(format == FrameFormat::Bayer10P ? bin * width : 0);
+	std::vector<uint16_t> sums(4 * out_width);
+	const uint16_t *rows[4];
+	for (int oy = row_begin; oy < row_end; ++oy) {
+		for (int dy = 0; dy < bin; ++dy) {
+			const uint8_t *row = raw + (oy * bin + dy) * stride;
+			if (format == FrameFormat::Bayer10P) {
+				unpackRaw10(row, &unpacked[dy * width], width);
+				rows[dy] = &unpacked[dy * width];
+			} else {
+				rows[dy] = reinterpret_cast<const uint16_t*>(row);
+			}
+		}
+		binBayerRows(rows, bin, out_width, sums.data());
+
+		uint8_t *out = rgb + oy * out_width * 3;
+		for (int x = 0; x < out_width; ++x, out += 3) {
+			const uint16_t *sum = &sums[4 * x];
+			out[0] = map.lut[0][std::min(max_level, sum[r] >> shift)];
+			out[1] = map.lut[1][std::min(max_level, (sum[g0] + sum[g1] + (1 << shift)) >> (shift + 1))]; // rounded
+			out[2] = map.lut[2][std::min(max_level, sum[b] >> shift)];
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CameraFrame.h"
+
+// Tensor conversion loops of the inference hot path, kept separate so they can be benchmarked
+
+// Widens an uint8 image to a float32 input tensor (no normalization, the model expects 0..255)
+void convertInputU8ToF32 (const uint8_t *src, float *dst, size_t count);
+
+// Dequantizes an output tensor: dst[i] = scale * (src[i] - zero_point)
+void dequantizeU8 (const uint8_t *src, float *dst, size_t count, float scale, int zero_point);
+void dequantizeI8 (const int8_t  *src, float *dst, size_t count, float scale, int zero_point);
+
+// --- Capture: reads of camera buffers ---
+
+// Copy with wide (64-byte) NEON loads and prefetch, for uncached or write-combined sources such as
+// dma-buf mappings where narrow reads are slow; plain memcpy elsewhere
+void streamCopy (const uint8_t *src, uint8_t *dst, size_t size);
+
+// --- Image preprocessing: camera frame to model input, in one pass ---
+
+// Bilinear resampling taps from a source size to a destination size, with pixel centers
+// aligned as OpenCV's INTER_LINEAR. Built once per size pair and reused for every frame.
+struct ResizeMap
+{
+	static constexpr int kOne = 1 << 11; // weight scale
+
+	int src_width  = 0;
+	int src_height = 0;
+	int dst_width  = 0;
+	int dst_height = 0;
+
+	// Left/top source sample of each destination column/row, and the weight of the next one
+	std::vector<int32_t>  x, y;
+	std::vector<uint16_t> wx, wy;
+	// Same on the half-resolution chroma plane of NV12
+	std::vector<int32_t>  cx, cy;
+	std::vector<uint16_t> cwx, cwy;
+
+	bool matches (int sw, int sh, int dw, int dh) const
+		{return sw == src_width && sh == src_height && dw == dst_width && dh == dst_height;}
+};
+
+void makeResizeMap (ResizeMap &map, int src_width, int src_height, int dst_width, int dst_height);
+
+// NV12 (Y plane and interleaved UV plane, same stride) to packed RGB at the map's destination
+// size. Y and UV are interpolated, then converted with the BT.601 limited-range matrix of
+// OpenCV's COLOR_YUV2RGB_NV12. Only destination rows [row_begin, row_end) are written (all by
+// default), so that bands of the output can be produced on several cores.
+void nv12ToRGBResize (const uint8_t *y_plane, const uint8_t *uv_plane, int stride, uint8_t *rgb, const ResizeMap &map,
+                      int row_begin = 0, int row_end = -1);
+
+// Packed BGR to packed RGB at the map's destination size
+void bgrToRGBResize (const uint8_t *bgr, int stride, uint8_t *rgb, const ResizeMap &map, int row_begin = 0, int row_end = -1);
+// Packed RGB resized, channels kept in order
+void rgbResize (const uint8_t *src, int stride, uint8_t *rgb, const ResizeMap &map, int row_begin = 0, int row_end = -1);
+
+// --- Raw Bayer frames: the ISP stages the model needs, done on the CPU ---
+
+// Per-channel lookup from a raw level to 8-bit RGB: black level, white balance and gamma at once.
+// Built once per RawInfo (levels and gains change slowly) and reused for every frame.
+struct RawToneMap
+{
+	RawInfo info;
+	std::vector<uint8_t> lut[3]; // R, G, B; indexed by raw level (0 .. 2^bit_depth - 1)
+
+	bool matches (const RawInfo &raw) const;
+};
+
+void makeRawToneMap (RawToneMap &map, const RawInfo &raw);
+
+// Demosaic by binning: each output RGB pixel is a bin×bin superpixel (bin 2 or 4) of the Bayer
+// mosaic, whose same-color sensor pixels are averaged, so no interpolation is needed. The output
+// is width/bin × height/bin; only its rows [row_begin, row_end) are written.
+void bayerToRGBBinned (const uint8_t *raw, FrameFormat format, int width, int stride, int bin, const RawToneMap &map,
+                       uint8_t *rgb, int row_begin, int row_end);
+
+#endif // KERNELS_H
@@ -0,0 +1,322 @@
+// Multi-stream load generator: drives N virtual cameras through the production FramePipeline
+// concurrently, sweeping the number of streams and of interpreter threads, and reports throughput
+// and latency percentiles per configuration. Used to size how many cameras one Pi can serve.
+//
+//   ./my_loadgen --streams 1,2,3,4 --threads 1,2,4 --fps 3 --seconds 30 [--replay frames.rpzf]
+//
+// Streams are synthetic NV12 frames unless --replay gives recorded frames: a frame file from
+// `my_interpreter --dump-frames` (any format, raw Bayer included), or plain NV12 frames of
+// width×height×3/2 bytes each. With --fps 0 every stream runs flat out;
+// otherwise frames are due at a fixed rate and latency is measured from the due time, so that
+// a stream falling behind shows up in the percentiles.
+//
+// With --offload, inference goes to a companion `my_interpreter --serve` (possibly on the same
+// machine) and falls back to the local interpreter past the budget.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "CameraFrame.h"
+#include "FrameFile.h"
+#include "FramePipeline.h"
+#include "ModelInterpreter.h"
+#include "Offload.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions
+{
+	std::vector<int> streams = {1, 2, 4};
+	std::vector<int> threads = {1, 2, 4};
+	double seconds = 10;
+	double fps     = 0;
+	int width      = 640;
+	int height     = 480;
+	std::string replay_file;
+	ModelOptions model;
+	std::string offload_host;   // empty: local inference only
+	unsigned short offload_port = 8091;
+	int offload_budget_ms = 40;
+};
+
+struct LoadResult
+{
+	int    streams;
+	int    threads;
+	size_t frames;
+	double seconds;
+	double p50_ms;
+	double p99_ms;
+	double max_ms;
+	long   rss_kb;
+};
+
+// Comma-separated positive integers; false on anything else
+static bool parseList (const char *text, std::vector<int> &values)
+{
+	values.clear();
+	std::stringstream stream(text);
+	for (std::string item; std::getline(stream, item, ','); ) {
+		char *end;
+		long value = strtol(item.c_str(), &end, 10);
+		if (*end || end == item.c_str() || value <= 0 || value > 1024) return false;
+		values.push_back(value);
+	}
+	return !values.empty();
+}
+
+// Non-negative number; false on anything else
+static bool parseNumber (const char *text, double &value)
+{
+	char *end;
+	value = strtod(text, &end);
+	return !*end && end != text && value >= 0;
+}
+
+static long residentKB ()
+{
+	long pages = 0, resident = 0;
+	std::ifstream statm("/proc/self/statm");
+	statm >> pages >> resident;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// A few NV12 frames with a moving pattern, different for each stream
+static std::vector<CameraFrame> syntheticFrames (int width, int height, int stream)
+{
+	std::vector<CameraFrame> frames(8);
+	for (size_t n = 0; n < frames.size(); ++n) {
+		CameraFrame &frame = frames[n];
+		frame.format = FrameFormat::NV12;
+		frame.width  = width;
+		frame.height = height;
+		frame.stride = width;
+		frame.sequence = n;
+		frame.data.resize(width * (height + height / 2));
+		for (int y = 0; y < height + height / 2; ++y)
+			for (int x = 0; x < width; ++x)
+				frame.data[y * width + x] = uint8_t((x + 8 * n) ^ (y + 16 * stream));
+	}
+	return frames;
+}
+
+static bool replayFrames (const LoadOptions &options, std::vector<CameraFrame> &frames)
+{
+	std::ifstream file(options.replay_file, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to open replay file: " << options.replay_file << std::endl;
+		return false;
+	}
+	std::string magic(16, '\0');
+	file.read(&magic[0], magic.size());
+	file.clear();
+	file.seekg(0);
+	if (magic == "raspizza-frame-1") {
+		CameraFrame frame;
+		while (frames.size() < 32 && readFrame(file, frame)) // bounded, the Zero 2 W only has 512 MB
+			frames.push_back(frame);
+		if (frames.empty()) {
+			std::cerr << "Replay file holds no complete frame." << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	const size_t frame_size = options.width * (options.height + options.height / 2);
+	for (uint32_t n = 0; n < 32; ++n) {
+		CameraFrame frame;
+		frame.format = FrameFormat::NV12;
+		frame.width  = options.width;
+		frame.height = options.height;
+		frame.stride = options.width;
+		frame.sequence = n;
+		frame.data.resize(frame_size);
+		if (!file.read(reinterpret_cast<char*>(frame.data.data()), frame_size)) break;
+		frames.push_back(std::move(frame));
+	}
+	if (frames.empty()) {
+		std::cerr << "Replay file holds no complete " << options.width << "×" << options.height << " NV12 frame." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// offload: created at the first configuration, the host must run the model just loaded
+static bool runConfiguration (const LoadOptions &options, const std::vector<CameraFrame> &replay,
+                              std::unique_ptr<OffloadClient> &offload, int num_streams, int num_threads, LoadResult &result)
+{
+	struct Stream
+	{
+		ModelInterpreter interpreter;
+		std::unique_ptr<FramePipeline> pipeline;
+		std::vector<CameraFrame> frames;
+		std::vector<double> latencies_ms;
+	};
+
+	std::vector<std::unique_ptr<Stream>> streams;
+	for (int s = 0; s < num_streams; ++s) {
+		auto stream = std::make_unique<Stream>();
+		ModelOptions model = options.model;
+		model.num_threads = num_threads;
+		if (!stream->interpreter.init(model)) return false;
+		if (!options.offload_host.empty() && !offload) {
+			offload = std::make_unique<OffloadClient>(options.offload_host, options.offload_port, std::chrono::milliseconds(options.offload_budget_ms),
+			                                          stream->interpreter.getModelHash(), stream->interpreter.getClassLabels().size());
+			std::this_thread::sleep_for(std::chrono::milliseconds(500)); // let it connect
+		}
+		stream->pipeline = std::make_unique<FramePipeline>(stream->interpreter);
+		stream->pipeline->setOffload(offload.get());
+		stream->frames = replay.empty() ? syntheticFrames(options.width, options.height, s) : replay;
+
+		// Warm-up, outside of the measurement
+		FrameResult warmup;
+		stream->pipeline->process(stream->frames[0], warmup);
+		streams.push_back(std::move(stream));
+	}
+
+	const Clock::time_point start = Clock::now();
+	const Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+	std::vector<std::thread> workers;
+	for (auto &stream_ptr : streams) {
+		Stream *stream = stream_ptr.get();
+		workers.emplace_back([stream, start, deadline, &options] {
+			for (size_t n = 0; ; ++n) {
+				Clock::time_point due = options.fps > 0
+					? start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(n / options.fps))
+					: Clock::now();
+				if (due >= deadline) break;
+				std::this_thread::sleep_until(due);
+
+				FrameResult frame_result;
+				stream->pipeline->process(stream->frames[n % stream->frames.size()], frame_result);
+				stream->latencies_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - due).count());
+			}
+		});
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+	const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::vector<double> latencies;
+	for (const auto &stream : streams)
+		latencies.insert(latencies.end(), stream->latencies_ms.begin(), stream->latencies_ms.end());
+	std::sort(latencies.begin(), latencies.end());
+
+	auto percentile = [&latencies] (double p) {
+		return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))];
+	};
+	result.streams = num_streams;
+	result.threads = num_threads;
+	result.frames  = latencies.size();
+	result.seconds = elapsed;
+	result.p50_ms  = percentile(0.50);
+	result.p99_ms  = percentile(0.99);
+	result.max_ms  = latencies.empty() ? 0 : latencies.back();
+	result.rss_kb  = residentKB();
+	if (options.model.delta.enabled) // speedups by changed area, best measured on --replay frames
+		std::cerr << "Delta: " << streams[0]->interpreter.getDeltaJson() << std::endl;
+	if (options.model.early_exit.enabled)
+		std::cerr << "Early exit: " << streams[0]->interpreter.getEarlyExitJson() << std::endl;
+	return true;
+}
+
+int main (int argc, char **argv)
+{
+	LoadOptions options;
+	options.model.model_file = "../models/my_model.tflite";
+	options.model.label_file = "../models/labels.txt";
+
+	for (int i = 1; i < argc; ++i) {
+		bool valid = true;
+		if (!strcmp(argv[i], "--streams") && i + 1 < argc) {
+			valid = parseList(argv[++i], options.streams);
+		} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			valid = parseList(argv[++i], options.threads);
+		} else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+			valid = parseNumber(argv[++i], options.seconds) && options.seconds > 0;
+		} else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+			valid = parseNumber(argv[++i], options.fps);
+		} else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+			valid = sscanf(argv[++i], "%dx%d", &options.width, &options.height) == 2 && options.width > 0 && options.height > 0;
+		} else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+			options.replay_file = argv[++i];
+		} else if (!strcmp(argv[i], "--model") && i + 1 < argc) {
+			options.model.model_file = argv[++i];
+		} else if (!strcmp(argv[i], "--labels") && i + 1 < argc) {
+			options.model.label_file = argv[++i];
+		} else if (!strcmp(argv[i], "--offload") && i + 1 < argc) {
+			const char *value = argv[++i];
+			options.offload_host = value;
+			size_t colon = options.offload_host.rfind(':');
+			if (colon != std::string::npos) {
+				options.offload_port = atoi(value + colon + 1);
+				options.offload_host.resize(colon);
+			}
+		} else if (!strcmp(argv[i], "--offload-budget") && i + 1 < argc) {
+			options.offload_budget_ms = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--delta-inference")) {
+			// Same options as my_interpreter
+			options.model.delta.enabled = true;
+		} else if (!strcmp(argv[i], "--delta-threshold") && i + 1 < argc) {
+			options.model.delta.pixel_threshold = std::max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--early-exit")) {
+			options.model.early_exit.enabled = true;
+		} else if (!strcmp(argv[i], "--exit-thresholds") && i + 1 < argc) {
+			const char *thresholds = argv[++i];
+			valid = strchr(thresholds, '=') ? parseClassThresholds(thresholds, options.model.early_exit.class_thresholds)
+			                                : (options.model.early_exit.threshold = atof(thresholds)) > 0;
+		} else {
+			std::cerr
+				<< "Usage: " << argv[0] << " [--streams 1,2,4] [--threads 1,2,4] [--seconds 10] [--fps 0]\n"
+				<< "       [--size 640x480] [--replay frames.rpzf|frames.nv12] [--model my_model.tflite] [--labels labels.txt]\n"
+				<< "       [--offload HOST[:PORT]] [--offload-budget 40] [--delta-inference [--delta-threshold N]]\n"
+				<< "       [--early-exit [--exit-thresholds T|LABEL=T,...]]" << std::endl;
+			return -1;
+		}
+		if (!valid) {
+			std::cerr << "Invalid value for " << argv[i - 1] << ": " << argv[i] << std::endl;
+			return -1;
+		}
+	}
+
+	std::vector<CameraFrame> replay;
+	if (!options.replay_file.empty() && !replayFrames(options, replay))
+		return -1;
+
+	std::unique_ptr<OffloadClient> offload;
+
+	std::vector<LoadResult> results;
+	for (int num_streams : options.streams) {
+		for (int num_threads : options.threads) {
+			std::cerr << "Running " << num_streams << " stream(s) × " << num_threads << " thread(s)..." << std::endl;
+			LoadResult result;
+			if (!runConfiguration(options, replay, offload, num_streams, num_threads, result)) {
+				std::cerr << "Failed to set up the configuration." << std::endl;
+				return -1;
+			}
+			results.push_back(result);
+		}
+	}
+
+	// One row per configuration, ready for plotting the scaling curves
+	std::cout << "\nstreams,threads,frames,fps_total,fps_per_stream,p50_ms,p99_ms,max_ms,rss_kb\n" << std::fixed << std::setprecision(2);
+	for (const LoadResult &r : results)
+		std::cout
+			<< r.streams << "," << r.threads << "," << r.frames << ","
+			<< r.frames / r.seconds << "," << r.frames / r.seconds / r.streams << ","
+			<< r.p50_ms << "," << r.p99_ms << "," << r.max_ms << "," << r.rss_kb << "\n";
+	if (offload)
+		std::cerr << "Offload: " << offload->toJson() << std::endl;
+	return 0;
+}
@@ -0,0 +1,131 @@
+#include "LockedMemory.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 // Linux 5.14
+#endif
+
+static constexpr size_t kHugePageSize = 2 << 20;
+
+static std::atomic<bool> locking {false};
+
+void setMemoryLocking (bool enable)
+{
+	locking = enable;
+}
+
+bool memoryLocking ()
+{
+	return locking;
+}
+
+bool transparentHugePagesAvailable ()
+{
+	// "[always] madvise never": anything but [never] honours MADV_HUGEPAGE
+	static const bool available = [] {
+		std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+		std::string mode;
+		std::getline(file, mode);
+		return file && mode.find("[never]") == std::string::npos;
+	}();
+	return available;
+}
+
+size_t hugePageBytes (const void *ptr, size_t size)
+{
+	const uintptr_t begin = reinterpret_cast<uintptr_t>(ptr), end = begin + size;
+	std::ifstream smaps("/proc/self/smaps");
+	size_t bytes = 0, overlap = 0;
+	for (std::string line; std::getline(smaps, line); ) {
+		unsigned long map_begin, map_end, kb;
+		if (sscanf(line.c_str(), "%lx-%lx ", &map_begin, &map_end) == 2)
+			overlap = map_begin < end && begin < map_end ? std::min<uintptr_t>(end, map_end) - std::max<uintptr_t>(begin, map_begin) : 0;
+		else if (overlap && sscanf(line.c_str(), "AnonHugePages: %lu kB", &kb) == 1)
+			bytes += std::min<size_t>(overlap, kb * 1024); // mappings partly in the range: at most the overlap
+	}
+	return bytes;
+}
+
+// Huge pages only pay off for allocations of about a huge page or more
+static bool useHugePages (size_t size)
+{
+	return size >= kHugePageSize / 2 && transparentHugePagesAvailable();
+}
+
+static size_t mappedSize (size_t size)
+{
+	const size_t page = useHugePages(size) ? kHugePageSize : sysconf(_SC_PAGESIZE);
+	return (size + page - 1) / page * page;
+}
+
+static bool lockRange (void *ptr, size_t size)
+{
+	if (!locking) return false;
+	if (mlock(ptr, size) != 0) {
+		static bool warned = false;
+		if (!warned) // typically RLIMIT_MEMLOCK, see `ulimit -l`
+			std::cerr << "Failed to lock memory: " << strerror(errno) << " (continuing unlocked)" << std::endl;
+		warned = true;
+		return false;
+	}
+	return true;
+}
+
+void *lockedAlloc (size_t size)
+{
+	if (!size) return nullptr;
+	const size_t length = mappedSize(size);
+	const bool huge = useHugePages(size);
+
+	// Over-allocate to align huge page backed mappings on a huge page boundary, then trim
+	const size_t slack = huge ? kHugePageSize : 0;
+	uint8_t *base = static_cast<uint8_t*>(mmap(nullptr, length + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (base == MAP_FAILED) return nullptr;
+	uint8_t *ptr = base;
+	if (huge) {
+		ptr = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(base) + kHugePageSize - 1) & ~(kHugePageSize - 1));
+		if (ptr > base) munmap(base, ptr - base);
+		if (ptr + length < base + length + slack) munmap(ptr + length, base + length + slack - (ptr + length));
+		madvise(ptr, length, MADV_HUGEPAGE);
+	}
+
+	// Pre-fault now rather than in the hot path
+	memset(ptr, 0, length);
+	lockRange(ptr, length);
+	return ptr;
+}
+
+void lockedFree (void *ptr, size_t size)
+{
+	if (ptr) munmap(ptr, mappedSize(size)); // also unlocks
+}
+
+bool pinRange (void *ptr, size_t size)
+{
+	if (!ptr || !size) return false;
+
+	// madvise() needs page-aligned bounds; only whole pages inside the range are touched
+	const uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t begin = (reinterpret_cast<uintptr_t>(ptr) + page - 1) & ~(page - 1);
+	uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size) & ~(page - 1);
+	if (end <= begin) return false;
+
+	if (transparentHugePagesAvailable()) {
+		uintptr_t huge_begin = (begin + kHugePageSize - 1) & ~(kHugePageSize - 1);
+		uintptr_t huge_end = end & ~(kHugePageSize - 1);
+		if (huge_end > huge_begin)
+			madvise(reinterpret_cast<void*>(huge_begin), huge_end - huge_begin, MADV_HUGEPAGE);
+	}
+
+	// Fault the pages in without writing to them; mlock() would do it too, but may not be allowed
+	madvise(reinterpret_cast<void*>(begin), end - begin, MADV_POPULATE_WRITE);
+	return lockRange(reinterpret_cast<void*>(begin), end - begin);
+}
@@ -0,0 +1,76 @@
+#ifndef LOCKED_MEMORY_H
+#define LOCKED_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Memory placement for the hot path: anonymous mappings that are pre-faulted, advised for
+// transparent huge pages when large enough (and THP is available), and mlock'ed when locking
+// is enabled. Keeps page faults and TLB misses out of Invoke() and of the frame conversions.
+
+// Global policy: lock new allocations (and pinned ranges) in RAM; off by default
+void setMemoryLocking (bool enable);
+bool memoryLocking ();
+
+bool transparentHugePagesAvailable ();
+// Bytes of [ptr, ptr + size) actually backed by transparent huge pages (AnonHugePages of /proc/self/smaps)
+size_t hugePageBytes (const void *ptr, size_t size);
+
+void *lockedAlloc (size_t size);            // nullptr on failure
+void  lockedFree  (void *ptr, size_t size); // size as passed to lockedAlloc
+
+// Prepares memory allocated elsewhere (e.g. the TFLite tensor arena) the same way, without
+// altering its content. Returns true if the range ended up locked.
+bool pinRange (void *ptr, size_t size);
+
+// Owned locked memory block
+class LockedBuffer
+{
+public:
+	LockedBuffer () : data_(nullptr), size_(0) {}
+	explicit LockedBuffer (size_t size) : data_(static_cast<uint8_t*>(lockedAlloc(size))), size_(data_ ? size : 0) {}
+	~LockedBuffer () { if (data_) lockedFree(data_, size_); }
+
+	LockedBuffer (LockedBuffer &&other) : data_(other.data_), size_(other.size_) { other.data_ = nullptr; other.size_ = 0; }
+	LockedBuffer &operator= (LockedBuffer &&other)
+	{
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		return *this;
+	}
+	LockedBuffer (const LockedBuffer&) = delete;
+	LockedBuffer &operator= (const LockedBuffer&) = delete;
+
+	uint8_t *data () const { return data_; }
+	size_t   size () const { return size_; }
+	explicit operator bool () const { return data_ != nullptr; }
+
+private:
+	uint8_t *data_;
+	size_t   size_;
+};
+
+// Standard allocator on top of lockedAlloc(), for containers holding frame data
+template <typename T>
+struct LockedAllocator
+{
+	using value_type = T;
+
+	LockedAllocator () = default;
+	template <typename U> LockedAllocator (const LockedAllocator<U>&) {}
+
+	T *allocate (size_t n)
+	{
+		void *ptr = lockedAlloc(n * sizeof(T));
+		if (!ptr) throw std::bad_alloc();
+		return static_cast<T*>(ptr);
+	}
+	void deallocate (T *ptr, size_t n) { lockedFree(ptr, n * sizeof(T)); }
+
+	template <typename U> bool operator== (const LockedAllocator<U>&) const { return true; }
+	template <typename U> bool operator!= (const LockedAllocator<U>&) const { return false; }
+};
+
+#endif // LOCKED_MEMORY_H
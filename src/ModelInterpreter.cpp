@@ -1,20 +1,91 @@
 #include <iostream>
 #include <fstream>
 #include <cmath> // For round
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // TensorFlow Lite includes
+#include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
 #include "tensorflow/lite/kernels/register.h"
+#include "tensorflow/lite/util.h" // kDefaultTensorAlignment
 
 #include "ModelInterpreter.h"
+#include "Kernels.h"
+#include "PipelineMetrics.h"
+#include "WeightCache.h"
+
+static TensorInfo describeTensor (const std::string &name, const TfLiteTensor *tensor)
+{
+	TensorInfo info;
+	info.name = name;
+	info.type = tensor->type;
+	info.shape.assign(tensor->dims->data, tensor->dims->data + tensor->dims->size);
+	info.bytes = tensor->bytes;
+	info.scale = tensor->params.scale;
+	info.zero_point = tensor->params.zero_point;
+	return info;
+}
+
+static void printTensor (const char *kind, size_t i, const TensorInfo &info)
+{
+	std::cout << " " << kind << " #" << i << " '" << info.name << "' shape:";
+	for (size_t j = 0; j < info.shape.size(); ++j)
+		std::cout << (j ? "×" : " ") << info.shape[j];
+	std::cout << " Type: " << info.type << "\n";
+}
+
+std::vector<float> dequantizeTensor(const TfLiteTensor *tensor)
+{
+	std::vector<float> values;
+	float scale = tensor->params.scale;
+	int zero_point = tensor->params.zero_point;
+
+	switch (tensor->type)
+	{
+	case kTfLiteFloat32:
+		values.assign(tensor->data.f, tensor->data.f + tensor->bytes / sizeof(float));
+		break;
+	case kTfLiteUInt8:
+		values.resize(tensor->bytes);
+		dequantizeU8(tensor->data.uint8, values.data(), values.size(), scale, zero_point);
+		break;
+	case kTfLiteInt8:
+		values.resize(tensor->bytes);
+		dequantizeI8(tensor->data.int8, values.data(), values.size(), scale, zero_point);
+		break;
+	default:
+		std::cerr << "Unsupported output tensor type: " << tensor->type << std::endl;
+		break;
+	}
+	return values;
+}
 
 ModelInterpreter::ModelInterpreter()
 {
 }
 
-bool ModelInterpreter::init()
+bool ModelInterpreter::init(const ModelOptions &options)
 {
-	const char *model_file = "model/my_model.tflite";
-	const char *label_file = "model/labels.txt";
+	const char *model_file = options.model_file.c_str();
+	const char *label_file = options.label_file.c_str();
+
+	// Boot timeline: each step's duration
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point boot = Clock::now();
+	Clock::time_point phase = boot;
+	boot_report_ = ModelBootReport();
+	auto mark = [this, &phase] (const char *name)
+	{
+		Clock::time_point now = Clock::now();
+		boot_report_.phases_ms.emplace_back(name, std::chrono::duration<double, std::milli>(now - phase).count());
+		phase = now;
+	};
 
 	// Load labels:
 	std::ifstream file(label_file);
@@ -30,6 +101,7 @@ bool ModelInterpreter::init()
 		std::cerr << "Failed to load labels from: " << label_file << std::endl;
 		return false;
 	}
+	mark("labels");
 
 	// Load model:
 	model_ = tflite::FlatBufferModel::BuildFromFile(model_file);
@@ -39,123 +111,564 @@ bool ModelInterpreter::init()
 		return false;
 	}
 
-	// Use built-in operations:
-	tflite::ops::builtin::BuiltinOpResolver resolver;
+	mark("load_model");
 
-	// Build model interpreter:
-	tflite::InterpreterBuilder builder(*model_, resolver);
-	builder.SetNumThreads(4);
+	// Identifies the model to the weight cache and to offload hosts
+	model_hash_ = 0;
+	if (model_->allocation())
+	{
+		model_hash_ = hashModel(model_->allocation()->base(), model_->allocation()->bytes());
+		mark("hash_model");
+	}
 
-	if (builder(&interpreter_) != kTfLiteOk)
+	// Packed weights from the cache of a previous start, for this very model and CPU
+	weight_cache_path_.clear();
+	if (!options.weight_cache_dir.empty() && model_hash_)
 	{
-		std::cerr << "Failed to build interpreter." << std::endl;
+		weight_cache_path_ = weightCachePath(options.weight_cache_dir, options.model_file, model_hash_);
+		boot_report_.weight_cache = weight_cache_path_;
+	}
+	struct stat cache_before;
+	const bool cache_existed = !weight_cache_path_.empty() && stat(weight_cache_path_.c_str(), &cache_before) == 0 && cache_before.st_size > 0;
+
+	// Build model interpreter (packing the weights, or mapping them from the cache):
+	bool built = buildInterpreter(options);
+	bool cache_discarded = false;
+	if (!built && cache_existed)
+	{
+		// Unusable cache (truncated, from another XNNPACK version...): packed again from scratch
+		std::cerr << "Discarding the weight cache " << weight_cache_path_ << std::endl;
+		unlink(weight_cache_path_.c_str());
+		cache_discarded = true;
+		built = buildInterpreter(options);
+	}
+	if (!built)
 		return false;
+	mark("build_interpreter");
+
+	// The delegate rewrites a cache it couldn't use (stale, other XNNPACK version...): the packed
+	// weights were only mapped if the file is still the one found before the build
+	struct stat cache_after;
+	boot_report_.weight_cache_hit = cache_existed && !cache_discarded
+		&& stat(weight_cache_path_.c_str(), &cache_after) == 0
+		&& cache_after.st_ino == cache_before.st_ino && cache_after.st_size == cache_before.st_size
+		&& cache_after.st_mtim.tv_sec == cache_before.st_mtim.tv_sec && cache_after.st_mtim.tv_nsec == cache_before.st_mtim.tv_nsec;
+
+	// Select the signature to run, if the model exports any:
+	runner_ = nullptr;
+	std::vector<const std::string*> signature_keys = interpreter_->signature_keys();
+	if (!options.signature_key.empty())
+	{
+		runner_ = interpreter_->GetSignatureRunner(options.signature_key.c_str());
+		if (!runner_)
+		{
+			std::cerr << "Model has no signature '" << options.signature_key << "'." << std::endl;
+			return false;
+		}
 	}
+	else if (!signature_keys.empty())
+		runner_ = interpreter_->GetSignatureRunner(signature_keys[0]->c_str());
 
-	if (interpreter_->AllocateTensors() != kTfLiteOk)
+	if ((runner_ ? runner_->AllocateTensors() : interpreter_->AllocateTensors()) != kTfLiteOk)
 	{
 		std::cerr << "Failed to allocate tensors." << std::endl;
 		return false;
 	}
+	mark("allocate_tensors");
+
+	// Collect input and output tensor details:
+	inputs_.clear();
+	outputs_.clear();
+	input_tensors_.clear();
+	output_tensors_.clear();
+	if (runner_)
+	{
+		for (const char *name : runner_->input_names())
+		{
+			input_tensors_.push_back(runner_->input_tensor(name));
+			inputs_.push_back(describeTensor(name, input_tensors_.back()));
+		}
+		for (const char *name : runner_->output_names())
+		{
+			output_tensors_.push_back(runner_->output_tensor(name));
+			outputs_.push_back(describeTensor(name, output_tensors_.back()));
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < interpreter_->inputs().size(); ++i)
+		{
+			input_tensors_.push_back(interpreter_->input_tensor(i));
+			inputs_.push_back(describeTensor(input_tensors_.back()->name ? input_tensors_.back()->name : "", input_tensors_.back()));
+		}
+		for (size_t i = 0; i < interpreter_->outputs().size(); ++i)
+		{
+			output_tensors_.push_back(interpreter_->output_tensor(i));
+			outputs_.push_back(describeTensor(output_tensors_.back()->name ? output_tensors_.back()->name : "", output_tensors_.back()));
+		}
+	}
+	bindings_.clear();
+	bindings_.resize(inputs_.size());
 
-	// Get input and output tensor details:
-	const TfLiteIntArray *input_dims = interpreter_->input_tensor(0)->dims;
-	if (input_dims->size != 4)
-	{ // NHWC format
-		std::cerr << "Invalid input tensor dimensions. Expected 4, got " << input_dims->size << std::endl;
+	// The image is the first NHWC input, any other input is auxiliary (sensor data...)
+	image_input_ = -1;
+	for (size_t i = 0; i < inputs_.size() && image_input_ < 0; ++i)
+		if (inputs_[i].shape.size() == 4)
+			image_input_ = i;
+	if (image_input_ < 0)
+	{
+		std::cerr << "No image input found. Expected a tensor with 4 dimensions (NHWC)." << std::endl;
+		return false;
+	}
+	const TensorInfo &image = inputs_[image_input_];
+	model_input_height_ = image.shape[1];
+	model_input_width_ = image.shape[2];
+	model_input_channels_ = image.shape[3];
+	model_input_type_ = image.type;
+	input_pool_ = std::make_unique<BufferPool>(model_input_width_ * model_input_height_ * model_input_channels_);
+
+	// The classification output is the first [1, N] output, preferring one matching the labels
+	detection_output_ = -1;
+	for (size_t i = 0; i < outputs_.size(); ++i)
+	{
+		const std::vector<int> &shape = outputs_[i].shape;
+		if (shape.size() != 2 || shape[0] != 1)
+			continue;
+		if (detection_output_ < 0 || shape[1] == (int) class_labels_.size())
+			detection_output_ = i;
+		if (shape[1] == (int) class_labels_.size())
+			break;
+	}
+	if (detection_output_ < 0)
+	{
+		std::cerr << "No classification output found. Expected a tensor of shape [1, N]." << std::endl;
+		return false;
+	}
+
+	delta_.reset();
+	early_exit_.reset();
+	if (options.delta.enabled && options.early_exit.enabled)
+	{
+		std::cerr << "Delta inference and early exit can't be combined." << std::endl;
 		return false;
 	}
-	model_input_height_ = input_dims->data[1];
-	model_input_width_ = input_dims->data[2];
-	model_input_channels_ = input_dims->data[3];
-	model_input_type_ = interpreter_->input_tensor(0)->type;
+	if (options.delta.enabled)
+	{
+		if (runner_ && (runner_->signature_key() == options.delta.stem_signature || runner_->signature_key() == options.delta.tail_signature))
+		{
+			std::cerr << "Select the full model's signature for delta inference." << std::endl;
+			return false;
+		}
+		if (model_input_type_ != kTfLiteUInt8 && model_input_type_ != kTfLiteFloat32)
+		{
+			std::cerr << "Unsupported input tensor type for delta inference: " << model_input_type_ << std::endl;
+			return false;
+		}
+		delta_ = std::make_unique<DeltaInference>();
+		if (!delta_->init(*interpreter_, options.delta, model_input_width_, model_input_height_, model_input_channels_, model_input_type_))
+			return false;
+	}
+	if (options.early_exit.enabled)
+	{
+		if (model_input_type_ != kTfLiteUInt8 && model_input_type_ != kTfLiteFloat32)
+		{
+			std::cerr << "Unsupported input tensor type for early exit: " << model_input_type_ << std::endl;
+			return false;
+		}
+		early_exit_ = std::make_unique<EarlyExit>();
+		if (!early_exit_->init(*interpreter_, options.early_exit, class_labels_, model_input_width_, model_input_height_, model_input_channels_, model_input_type_))
+			return false;
+	}
+	if (delta_ || early_exit_)
+		mark("segments");
 
-	std::cout
-		<< "Model loaded successfully:\n"
-		<< " Input     shape: " << model_input_width_ << "×" << model_input_height_ << "×" << model_input_channels_
-		<< " Type: " << model_input_type_
-		<< "\n";
-	for (int i = 0; i < interpreter_->outputs().size(); ++i)
+	// After the segments, so that their arenas are pinned too
+	if (options.lock_memory)
 	{
-		const TfLiteTensor *output_tensor = interpreter_->output_tensor(i);
-		std::cout << " Output #" << i << " shape:";
-		for (int j = 0; j < output_tensor->dims->size; ++j)
-			std::cout << (j ? "×" : " ") << output_tensor->dims->data[j];
-		std::cout << " Type: " << output_tensor->type << "\n";
+		if (!prepareMemory())
+			return false;
+		mark("prepare_memory");
 	}
 
+	boot_report_.total_ms = std::chrono::duration<double, std::milli>(Clock::now() - boot).count();
+	struct stat cache;
+	if (!weight_cache_path_.empty() && stat(weight_cache_path_.c_str(), &cache) == 0)
+		boot_report_.weight_cache_bytes = cache.st_size;
+
+	std::cout << "Model loaded successfully";
+	if (runner_)
+		std::cout << " (signature '" << runner_->signature_key() << "')";
+	std::cout << ":\n";
+	for (size_t i = 0; i < inputs_.size(); ++i)
+		printTensor("Input ", i, inputs_[i]);
+	for (size_t i = 0; i < outputs_.size(); ++i)
+		printTensor("Output", i, outputs_[i]);
+	if (options.lock_memory)
+		std::cout
+			<< " Memory: arena " << memory_report_.arena_bytes / 1024 << " KiB"
+			<< ", persistent " << memory_report_.persistent_bytes / 1024 << " KiB"
+			<< ", I/O " << memory_report_.io_bytes / 1024 << " KiB"
+			<< (memory_report_.locked ? ", locked" : ", not locked")
+			<< ", huge pages " << memory_report_.huge_page_bytes / 1024 << " KiB"
+			<< ", warm-up faults " << memory_report_.minor_faults << " minor / " << memory_report_.major_faults << " major\n";
+	std::cout << " Boot:";
+	for (const auto &step : boot_report_.phases_ms)
+		std::cout << " " << step.first << " " << step.second << " ms,";
+	std::cout << " total " << boot_report_.total_ms << " ms";
+	if (!weight_cache_path_.empty())
+		std::cout << ", weight cache " << (boot_report_.weight_cache_hit ? "mapped" : "built") << " (" << boot_report_.weight_cache_bytes / 1024 << " KiB)";
+	std::cout << "\n";
+
 	return true;
 }
 
-std::vector<Detection> ModelInterpreter::runInference(const uint8_t *image_data)
+// Builds the interpreter, with an XNNPACK delegate of our own when its packed weights are cached
+bool ModelInterpreter::buildInterpreter(const ModelOptions &options)
 {
-	std::vector<Detection> detections;
+	interpreter_.reset();
+	delegate_.reset();
 
-	// Copy the image data into the input tensor
-	// Data type must match the model (e.g., uint8_t or float32).
-	if (model_input_type_ == kTfLiteUInt8)
+	// Use built-in operations (and the default XNNPACK delegate unless ours replaces it):
+	std::unique_ptr<tflite::OpResolver> resolver;
+	if (weight_cache_path_.empty())
+		resolver = std::make_unique<tflite::ops::builtin::BuiltinOpResolver>();
+	else
+		resolver = std::make_unique<tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates>();
+
+	tflite::InterpreterBuilder builder(*model_, *resolver);
+	builder.SetNumThreads(options.num_threads);
+	if (!weight_cache_path_.empty())
 	{
-		uint8_t *input_tensor_ptr = interpreter_->typed_input_tensor<uint8_t>(0);
-		std::memcpy(input_tensor_ptr, image_data, model_input_width_ * model_input_height_ * model_input_channels_);
+		TfLiteXNNPackDelegateOptions xnnpack = TfLiteXNNPackDelegateOptionsDefault();
+		xnnpack.num_threads = options.num_threads;
+		xnnpack.weight_cache_file_path = weight_cache_path_.c_str(); // mapped if valid, written otherwise
+		delegate_ = std::unique_ptr<TfLiteDelegate, void (*)(TfLiteDelegate*)>(TfLiteXNNPackDelegateCreate(&xnnpack), TfLiteXNNPackDelegateDelete);
+		if (!delegate_)
+		{
+			std::cerr << "Failed to create the XNNPACK delegate." << std::endl;
+			return false;
+		}
+		builder.AddDelegate(delegate_.get());
 	}
-	else if (model_input_type_ == kTfLiteFloat32)
+
+	if (builder(&interpreter_) != kTfLiteOk)
 	{
-		// If the model expects float32 and the input is uint8, the data must be scaled:
-		float *input_tensor_ptr = interpreter_->typed_input_tensor<float>(0);
-		for (int i = 0; i < model_input_width_ * model_input_height_ * model_input_channels_; ++i)
-			input_tensor_ptr[i] = static_cast<float>(image_data[i]);
+		std::cerr << "Failed to build interpreter." << std::endl;
+		interpreter_.reset();
+		return false;
 	}
+	return true;
+}
+
+// Moves the I/O tensors into locked memory, pins the tensor arenas and runs a warm-up
+// inference, so that no page fault is left for the first frames
+bool ModelInterpreter::prepareMemory()
+{
+	memory_report_ = ModelMemoryReport();
+
+	// Inputs to their staging buffers, outputs to buffers of their own
+	for (size_t i = 0; i < inputs_.size(); ++i)
+	{
+		InputBinding &binding = bindings_[i];
+		binding.staging = LockedBuffer(inputs_[i].bytes);
+		if (!binding.staging || !bindTensor(i, binding.staging.data(), inputs_[i].bytes))
+			return false;
+		binding.external = nullptr;
+		memory_report_.io_bytes += inputs_[i].bytes;
+	}
+	output_buffers_.clear();
+	for (size_t i = 0; i < outputs_.size(); ++i)
+	{
+		output_buffers_.emplace_back(outputs_[i].bytes);
+		TfLiteCustomAllocation allocation = {output_buffers_.back().data(), outputs_[i].bytes};
+		TfLiteStatus status = runner_
+			? runner_->SetCustomAllocationForOutputTensor(outputs_[i].name.c_str(), allocation)
+			: interpreter_->SetCustomAllocationForTensor(interpreter_->outputs()[i], allocation);
+		if (!output_buffers_.back() || status != kTfLiteOk)
+		{
+			std::cerr << "Failed to bind buffer to output '" << outputs_[i].name << "'." << std::endl;
+			return false;
+		}
+		memory_report_.io_bytes += outputs_[i].bytes;
+	}
+	if ((runner_ ? runner_->AllocateTensors() : interpreter_->AllocateTensors()) != kTfLiteOk)
+	{
+		std::cerr << "Failed to allocate tensors." << std::endl;
+		return false;
+	}
+
+	// Each subgraph (signature, delta and early-exit segments included) has its own arenas, single
+	// blocks whose extent is the one of the tensors they hold
+	memory_report_.locked = memoryLocking();
+	for (size_t g = 0; g < interpreter_->subgraphs_size(); ++g)
+	{
+		tflite::Subgraph &subgraph = *interpreter_->subgraph(g);
+		uintptr_t begin[2] = {UINTPTR_MAX, UINTPTR_MAX}, end[2] = {0, 0};
+		for (size_t i = 0; i < subgraph.tensors_size(); ++i)
+		{
+			const TfLiteTensor *tensor = subgraph.tensor(i);
+			int arena = tensor->allocation_type == kTfLiteArenaRw ? 0 : tensor->allocation_type == kTfLiteArenaRwPersistent ? 1 : -1;
+			if (arena < 0 || !tensor->data.raw || !tensor->bytes)
+				continue;
+			begin[arena] = std::min(begin[arena], reinterpret_cast<uintptr_t>(tensor->data.raw));
+			end[arena] = std::max(end[arena], reinterpret_cast<uintptr_t>(tensor->data.raw) + tensor->bytes);
+		}
+		for (int arena = 0; arena < 2; ++arena)
+		{
+			if (end[arena] <= begin[arena])
+				continue;
+			(arena ? memory_report_.persistent_bytes : memory_report_.arena_bytes) += end[arena] - begin[arena];
+			memory_report_.locked &= pinRange(reinterpret_cast<void*>(begin[arena]), end[arena] - begin[arena]);
+			memory_report_.huge_page_bytes += hugePageBytes(reinterpret_cast<void*>(begin[arena]), end[arena] - begin[arena]);
+		}
+	}
+
+	// Warm-up inference: whatever still faults (delegate workspaces...) does it now
+	rusage before, after;
+	getrusage(RUSAGE_SELF, &before);
+	if (!invoke())
+		return false;
+	getrusage(RUSAGE_SELF, &after);
+	memory_report_.minor_faults = after.ru_minflt - before.ru_minflt;
+	memory_report_.major_faults = after.ru_majflt - before.ru_majflt;
+	return true;
+}
+
+int ModelInterpreter::findInput(const std::string &name) const
+{
+	for (size_t i = 0; i < inputs_.size(); ++i)
+		if (inputs_[i].name == name)
+			return i;
+	return -1;
+}
+
+int ModelInterpreter::findOutput(const std::string &name) const
+{
+	for (size_t i = 0; i < outputs_.size(); ++i)
+		if (outputs_[i].name == name)
+			return i;
+	return -1;
+}
+
+// Points the input tensor at the given memory through a TFLite custom allocation
+bool ModelInterpreter::bindTensor(int input, const void *data, size_t bytes)
+{
+	TfLiteCustomAllocation allocation = {const_cast<void*>(data), bytes};
+	TfLiteStatus status;
+	if (runner_)
+		status = runner_->SetCustomAllocationForInputTensor(inputs_[input].name.c_str(), allocation);
 	else
+		status = interpreter_->SetCustomAllocationForTensor(interpreter_->inputs()[input], allocation);
+	if (status != kTfLiteOk)
 	{
-		std::cerr << "Unsupported input tensor type: " << model_input_type_ << std::endl;
-		return detections;
+		std::cerr << "Failed to bind buffer to input '" << inputs_[input].name << "'." << std::endl;
+		return false;
 	}
 
-	// Performs inference
-	if (interpreter_->Invoke() != kTfLiteOk)
+	// The first custom allocation of a tensor takes it out of the arena, which needs re-planning
+	if (!bindings_[input].custom)
 	{
-		std::cerr << "Failed to invoke TFLite interpreter." << std::endl;
-		return detections;
+		bindings_[input].custom = true;
+		if ((runner_ ? runner_->AllocateTensors() : interpreter_->AllocateTensors()) != kTfLiteOk)
+		{
+			std::cerr << "Failed to allocate tensors." << std::endl;
+			return false;
+		}
 	}
+	return true;
+}
 
-	// Post-processing: retrieve output tensors
-	TfLiteTensor *output_tensor = interpreter_->output_tensor(0);
-	if (!output_tensor)
+// Returns writable memory for an input, moving it away from any external buffer it was bound to
+uint8_t *ModelInterpreter::stageInput(int input)
+{
+	InputBinding &binding = bindings_[input];
+	if (binding.custom && (binding.external || !binding.staging))
 	{
-		std::cerr << "Failed to get output tensor." << std::endl;
-		return detections;
+		if (!binding.staging)
+			binding.staging = LockedBuffer(inputs_[input].bytes); // page aligned
+		if (!binding.staging || !bindTensor(input, binding.staging.data(), inputs_[input].bytes))
+			return nullptr;
+		binding.external = nullptr;
+	}
+	return static_cast<uint8_t*>(input_tensors_[input]->data.data);
+}
+
+bool ModelInterpreter::bindInput(int input, const void *data, size_t bytes)
+{
+	if (input < 0 || input >= (int) inputs_.size() || bytes != inputs_[input].bytes)
+	{
+		std::cerr << "Invalid binding for input #" << input << " (" << bytes << " bytes)." << std::endl;
+		return false;
+	}
+
+	InputBinding &binding = bindings_[input];
+	if (reinterpret_cast<uintptr_t>(data) % tflite::kDefaultTensorAlignment == 0)
+	{
+		if (binding.external == data)
+			return true;
+		if (!bindTensor(input, data, bytes))
+			return false;
+		binding.external = data;
+		return true;
+	}
+
+	// Unaligned buffers can't be used by the runtime directly:
+	uint8_t *tensor_data = stageInput(input);
+	if (!tensor_data)
+		return false;
+	std::memcpy(tensor_data, data, bytes);
+	return true;
+}
+
+bool ModelInterpreter::setInput(int input, const float *values, size_t count)
+{
+	if (input < 0 || input >= (int) inputs_.size())
+		return false;
+	const TensorInfo &info = inputs_[input];
+	uint8_t *tensor_data = stageInput(input);
+	if (!tensor_data)
+		return false;
+
+	size_t element_size = info.type == kTfLiteFloat32 || info.type == kTfLiteInt32 ? 4 : 1;
+	if (count * element_size != info.bytes)
+	{
+		std::cerr << "Input '" << info.name << "' expects " << info.bytes / element_size << " values, got " << count << "." << std::endl;
+		return false;
+	}
+
+	float scale = info.scale != 0 ? info.scale : 1;
+	switch (info.type)
+	{
+	case kTfLiteFloat32:
+		std::memcpy(tensor_data, values, info.bytes);
+		break;
+	case kTfLiteInt32:
+		for (size_t i = 0; i < count; ++i)
+			reinterpret_cast<int32_t*>(tensor_data)[i] = std::lround(values[i]);
+		break;
+	case kTfLiteUInt8:
+		for (size_t i = 0; i < count; ++i)
+			tensor_data[i] = std::min(255l, std::max(0l, std::lround(values[i] / scale) + info.zero_point));
+		break;
+	case kTfLiteInt8:
+		for (size_t i = 0; i < count; ++i)
+			reinterpret_cast<int8_t*>(tensor_data)[i] = std::min(127l, std::max(-128l, std::lround(values[i] / scale) + info.zero_point));
+		break;
+	default:
+		std::cerr << "Unsupported input tensor type: " << info.type << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ModelInterpreter::invoke()
+{
+	ScopedStage stage(PipelineMetrics::Invoke);
+	if ((runner_ ? runner_->Invoke() : interpreter_->Invoke()) != kTfLiteOk)
+	{
+		std::cerr << "Failed to invoke TFLite interpreter." << std::endl;
+		return false;
 	}
+	return true;
+}
+
+std::vector<float> ModelInterpreter::getOutput(int output) const
+{
+	if (output < 0 || output >= (int) outputs_.size())
+		return std::vector<float>();
+	return dequantizeTensor(output_tensors_[output]);
+}
+
+std::vector<Detection> ModelInterpreter::getDetections(int output) const
+{
+	std::vector<Detection> detections;
 
 	// Dimensions of the tensor output are: [1, 4]
 	// output_tensor->dims->data[0] = 1 (batch)
 	// output_tensor->dims->data[1] = 4 (class probabilities)
-	model_output_type_ = output_tensor->type;
-	int num_classes = output_tensor->dims->data[1];
-	std::cout << "n classes: " << num_classes << std::endl;
-	if (output_tensor->dims->size != 2 || output_tensor->dims->data[0] != 1)
+	if (output < 0 || output >= (int) outputs_.size() || outputs_[output].shape.size() != 2 || outputs_[output].shape[0] != 1)
 	{
 		std::cerr << "Unexpected output shape." << std::endl;
 		return detections;
 	}
 
-	if (model_output_type_ == kTfLiteUInt8) {
-		std::cout << "endtered in kTfLiteFloat8: " << std::endl;
-		const uint8_t* raw_predictions_data = interpreter_->typed_output_tensor<uint8_t>(0);
+	std::vector<float> confidences = getOutput(output);
+	for (size_t class_id = 0; class_id < confidences.size(); ++class_id)
+		detections.push_back(Detection{(int) class_id, confidences[class_id]});
+	return detections;
+}
 
-		for (int class_id = 0; class_id < num_classes; ++class_id) {
-			uint8_t qval = raw_predictions_data[class_id];
-			float confidence = model_output_scale_ * (static_cast<int>(qval) - model_output_zero_);
-			detections.push_back(Detection{class_id, confidence});
-		}
-	} else if (model_output_type_ == kTfLiteFloat32) {
-		std::cout << "endtered in kTfLiteFloat32: " << std::endl;
-		const float *raw_predictions_data = interpreter_->typed_output_tensor<float>(0);
+std::vector<Detection> ModelInterpreter::runInference(const uint8_t *image_data)
+{
+	if (early_exit_)
+	{
+		std::vector<Detection> detections;
+		std::vector<float> confidences = early_exit_->run(image_data);
+		for (size_t class_id = 0; class_id < confidences.size(); ++class_id)
+			detections.push_back(Detection{(int) class_id, confidences[class_id]});
+		return detections;
+	}
+	if (!delta_)
+		return runFullInference(image_data);
 
-		for (int class_id = 0; class_id < num_classes; ++class_id) {
-			float confidence = raw_predictions_data[class_id];
-			detections.push_back(Detection{class_id, confidence});
-		}
+	const TfLiteTensor *output = delta_->run(image_data);
+	if (!output)
+		return std::vector<Detection>();
+	std::vector<Detection> detections;
+	{
+		ScopedStage stage(PipelineMetrics::Postprocess);
+		std::vector<float> confidences = dequantizeTensor(output);
+		for (size_t class_id = 0; class_id < confidences.size(); ++class_id)
+			detections.push_back(Detection{(int) class_id, confidences[class_id]});
+	}
+
+	// Every so often, the same image through the full model: both results must agree
+	if (delta_->checkDue())
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::vector<Detection> full = runFullInference(image_data);
+		double full_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::vector<float> delta_confidences, full_confidences;
+		for (const Detection &detection : detections)
+			delta_confidences.push_back(detection.confidence);
+		for (const Detection &detection : full)
+			full_confidences.push_back(detection.confidence);
+		delta_->check(delta_confidences, full_confidences, full_ms);
 	}
-	
 	return detections;
 }
+
+std::vector<Detection> ModelInterpreter::runFullInference(const uint8_t *image_data)
+{
+	std::vector<Detection> detections;
+
+	// Hand the image data to the input tensor
+	// Data type must match the model (e.g., uint8_t or float32).
+	size_t input_size = model_input_width_ * model_input_height_ * model_input_channels_;
+	if (model_input_type_ == kTfLiteUInt8)
+	{
+		if (!bindInput(image_input_, image_data, input_size))
+			return detections;
+	}
+	else if (model_input_type_ == kTfLiteFloat32)
+	{
+		// If the model expects float32 and the input is uint8, the data must be scaled:
+		float *input_tensor_ptr = reinterpret_cast<float*>(stageInput(image_input_));
+		if (!input_tensor_ptr)
+			return detections;
+		convertInputU8ToF32(image_data, input_tensor_ptr, input_size);
+	}
+	else
+	{
+		std::cerr << "Unsupported input tensor type: " << model_input_type_ << std::endl;
+		return detections;
+	}
+
+	// Performs inference
+	if (!invoke())
+		return detections;
+
+	// Post-processing: retrieve the classification output
+	ScopedStage stage(PipelineMetrics::Postprocess);
+	return getDetections(detection_output_);
+}
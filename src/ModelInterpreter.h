@@ -2,15 +2,19 @@
 #define MODEL_INTERPRETER_H
 
 #include <string>
+#include <utility>
 #include <vector>
 #include <memory>
 
-// OpenCV:
-#include <opencv2/opencv.hpp>
-
 // TensorFlow Lite:
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/model.h"
+#include "tensorflow/lite/signature_runner.h"
+
+#include "BufferPool.h"
+#include "DeltaInference.h"
+#include "EarlyExit.h"
+#include "LockedMemory.h"
 
 // Structure for containing detection results
 struct Detection
@@ -19,42 +23,152 @@ struct Detection
 	float     confidence;
 };
 
+// Model loading options
+struct ModelOptions
+{
+	std::string model_file    = "model/my_model.tflite";
+	std::string label_file    = "model/labels.txt";
+	std::string signature_key;    // empty: first signature of the model, or the plain graph if it has none
+	int         num_threads   = 4;
+	bool        lock_memory   = false; // pre-fault, mlock and THP-advise the tensor arena and I/O buffers
+	std::string weight_cache_dir;      // XNNPACK packed weights persisted there (empty: repacked at every start)
+	DeltaOptions delta;                // experimental: recompute only the changed tiles of the early layers
+	EarlyExitOptions early_exit;       // multi-exit models: stop at the first confident classifier head
+};
+
+// Memory placement of the model, and page faults of the first (warm-up) inference
+struct ModelMemoryReport
+{
+	size_t arena_bytes      = 0; // non-persistent tensor arenas, of every subgraph
+	size_t persistent_bytes = 0; // persistent arenas (state, scratch)
+	size_t io_bytes         = 0; // input/output tensors in custom allocations
+	bool   locked           = false;
+	size_t huge_page_bytes  = 0; // of the arenas, actually backed by transparent huge pages
+	long   minor_faults     = 0;
+	long   major_faults     = 0;
+};
+
+// Time spent in each step of init(), and how the packed weights were obtained
+struct ModelBootReport
+{
+	std::vector<std::pair<const char*, double>> phases_ms;
+	double      total_ms           = 0;
+	std::string weight_cache;              // cache file, empty without one
+	bool        weight_cache_hit   = false; // mapped from a previous start, rather than packed
+	size_t      weight_cache_bytes = 0;
+};
+
+// Description of a model input or output
+struct TensorInfo
+{
+	std::string      name;        // signature name (or tensor name for models without signatures)
+	TfLiteType       type;
+	std::vector<int> shape;
+	size_t           bytes;
+	float            scale;       // quantization parameters, scale is 0 if not quantized
+	int              zero_point;
+};
+
+// Dequantized copy of a tensor (float, uint8 or int8)
+std::vector<float> dequantizeTensor (const TfLiteTensor *tensor);
+
 class ModelInterpreter
 {
 public:
 	ModelInterpreter ();
 
 	// Initialize TFLite interpreter
-	bool init ();
+	bool init (const ModelOptions &options = ModelOptions());
 
-	// Performs inference and returns detections
+	// Performs inference on the image input and returns detections from the classification output
+	// (with delta inference, reusing the early layers' results for the tiles that didn't change)
 	std::vector<Detection> runInference (const uint8_t* image_data);
 
+	// Buffers for preprocessed images (input width × height × channels, uint8), aligned so that
+	// runInference() binds them to the input tensor instead of copying. Thread-safe, so frames
+	// can be preprocessed into them while another one is being inferred.
+	std::shared_ptr<LockedBuffer> acquireInputBuffer () {return input_pool_->acquire();}
+
+	// Generic multi-input/multi-output access; inputs and outputs are addressed by their position
+	// in getInputs()/getOutputs(), use findInput()/findOutput() to look them up by name
+	const std::vector<TensorInfo> &getInputs  () const {return inputs_;}
+	const std::vector<TensorInfo> &getOutputs () const {return outputs_;}
+	int findInput  (const std::string &name) const;
+	int findOutput (const std::string &name) const;
+
+	// Binds an external buffer (already in the tensor's type and layout) to an input without copying.
+	// The buffer must stay valid until the next invoke() has returned; unaligned buffers are copied.
+	bool bindInput (int input, const void *data, size_t bytes);
+	// Sets an auxiliary input (e.g. oven temperature) from float values, quantizing them if needed
+	bool setInput  (int input, const float *values, size_t count);
+	bool invoke    ();
+	// Dequantized copy of an output
+	std::vector<float> getOutput (int output) const;
+	// Interprets an output of shape [1, N] as class probabilities
+	std::vector<Detection> getDetections (int output) const;
+
 	// Model information retrival
 	int getInputWidth  () const {return model_input_width_;}
 	int getInputHeight () const {return model_input_height_;}
 	const std::vector<std::string> &getClassLabels () const {return class_labels_;}
+	uint64_t getModelHash () const {return model_hash_;} // of the model file, 0 if it isn't mapped
+	const ModelMemoryReport &getMemoryReport () const {return memory_report_;}
+	const ModelBootReport &getBootReport () const {return boot_report_;}
+	// Delta inference speedups and checks against full inference, empty if it's disabled
+	std::string getDeltaJson () const {return delta_ ? delta_->toJson() : std::string();}
+	// Exits taken and their latencies, empty if early exit is disabled
+	std::string getEarlyExitJson () const {return early_exit_ ? early_exit_->toJson() : std::string();}
 
 private:
 	// Neural network handlement
 	std::vector<std::string> class_labels_;
+	uint64_t model_hash_ = 0;
+	std::string weight_cache_path_;
+	std::unique_ptr<TfLiteDelegate, void (*)(TfLiteDelegate*)> delegate_ {nullptr, nullptr}; // outlives the interpreter
 	std::unique_ptr<tflite::FlatBufferModel> model_;
 	std::unique_ptr<tflite::Interpreter> interpreter_;
-	
+	tflite::SignatureRunner *runner_ = nullptr; // null if the model is used without signatures
+
+	// Inputs and outputs, with the tensors backing them
+	std::vector<TensorInfo> inputs_;
+	std::vector<TensorInfo> outputs_;
+	std::vector<TfLiteTensor*> input_tensors_;
+	std::vector<const TfLiteTensor*> output_tensors_;
+
+	// Zero-copy binding state of each input
+	struct InputBinding
+	{
+		const void *external = nullptr; // currently bound external buffer
+		bool        custom   = false;   // tensor uses a custom allocation (external or staging)
+		LockedBuffer staging;             // owned aligned copy target
+	};
+	std::vector<InputBinding> bindings_;
+	std::vector<LockedBuffer> output_buffers_; // with lock_memory only
+
+	bool bindTensor (int input, const void *data, size_t bytes);
+	uint8_t *stageInput (int input);
+
+	ModelMemoryReport memory_report_;
+	bool prepareMemory ();
+
+	ModelBootReport boot_report_;
+	bool buildInterpreter (const ModelOptions &options);
+
+	std::unique_ptr<BufferPool> input_pool_;
+	std::unique_ptr<DeltaInference> delta_;
+	std::unique_ptr<EarlyExit> early_exit_;
+
+	std::vector<Detection> runFullInference (const uint8_t *image_data);
+
+	// Image input and classification output used by runInference()
+	int image_input_       = -1;
+	int detection_output_  = -1;
+
 	// Model input details
 	int model_input_width_    = 0;
 	int model_input_height_   = 0;
 	int model_input_channels_ = 0;
 	TfLiteType model_input_type_ = kTfLiteNoType; // Only kTfLiteUInt8 and kTfLiteFloat32 are supported
-	TfLiteType model_output_type_ = kTfLiteNoType;
-
-	// Quantization details
-	float model_input_scale_  = 0;
-	int model_input_zero_	  = 0;
-	float model_output_scale_ = 0;
-	int model_output_zero_    = 0;
-	float x_scale_ = 1;
-	float y_scale_ = 1;
 };
 
-#endif // MODEL_INTERPRETER_H
\ No newline at end of file
+#endif // MODEL_INTERPRETER_H
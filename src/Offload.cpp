@@ -0,0 +1,407 @@
+#include "Offload.h"
+#include <iostream>
+#include <cstring>
+#include <sstream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Tracer.h"
+
+static constexpr uint32_t kMagic = 0x315a5052;      // "RPZ1"
+static constexpr uint32_t kHelloMagic = 0x485a5052; // "RPZH"
+static constexpr unsigned kMaxMisses = 3;                // consecutive misses before skipping the host
+static constexpr std::chrono::seconds kSkipPeriod(10);   // how long a slow host is skipped
+static constexpr size_t kMaxPayload = 4 << 20;
+
+struct MessageHeader
+{
+	uint32_t magic;
+	uint32_t id;
+	uint32_t count; // request: input bytes, reply: float32 confidences
+};
+
+struct Hello
+{
+	uint32_t magic;
+	uint32_t classes;
+	uint64_t model_hash;
+};
+
+static bool sendAll (int fd, const void *data, size_t length)
+{
+	const char *bytes = static_cast<const char*>(data);
+	while (length) {
+		ssize_t n = send(fd, bytes, length, MSG_NOSIGNAL);
+		if (n <= 0) return false;
+		bytes += n;
+		length -= n;
+	}
+	return true;
+}
+
+// Blocking receive, waking up regularly to notice a stop
+static bool recvAll (int fd, void *data, size_t length, const std::atomic<bool> &running)
+{
+	char *bytes = static_cast<char*>(data);
+	while (length) {
+		pollfd pfd = {fd, POLLIN, 0};
+		int ready = poll(&pfd, 1, 200);
+		if (!running) return false;
+		if (ready <= 0) continue;
+		ssize_t n = recv(fd, bytes, length, 0);
+		if (n <= 0) return false;
+		bytes += n;
+		length -= n;
+	}
+	return true;
+}
+
+static void setNoDelay (int fd)
+{
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// --- OffloadServer ---
+
+OffloadServer::OffloadServer (ModelInterpreter &interpreter) :
+	interpreter_(interpreter),
+	listen_fd_(-1),
+	running_(false)
+{
+}
+
+OffloadServer::~OffloadServer ()
+{
+	stop();
+}
+
+bool OffloadServer::start (unsigned short port)
+{
+	listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd_ < 0) {
+		std::cerr << "Failed to create offload socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	int one = 1;
+	setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	// Reachable from the local network, for the Pis of the store
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd_, 8) != 0) {
+		std::cerr << "Failed to listen on offload port " << port << ": " << strerror(errno) << std::endl;
+		close(listen_fd_);
+		listen_fd_ = -1;
+		return false;
+	}
+
+	running_ = true;
+	thread_ = std::thread(&OffloadServer::serve, this);
+	std::cout << "Serving inference on port " << port << std::endl;
+	return true;
+}
+
+void OffloadServer::stop ()
+{
+	running_ = false;
+	if (thread_.joinable()) thread_.join();
+	{
+		std::lock_guard<std::mutex> lock(connections_mutex_);
+		for (Connection &connection : connections_)
+			connection.thread.join();
+		connections_.clear();
+	}
+	if (listen_fd_ >= 0) close(listen_fd_);
+	listen_fd_ = -1;
+}
+
+void OffloadServer::serve ()
+{
+	while (running_) {
+		pollfd pfd = {listen_fd_, POLLIN, 0};
+		if (poll(&pfd, 1, 200) <= 0) continue;
+
+		int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) continue;
+		setNoDelay(fd);
+		std::lock_guard<std::mutex> lock(connections_mutex_);
+		connections_.remove_if([] (Connection &connection) { // reap the closed ones
+			if (!*connection.done) return false;
+			connection.thread.join();
+			return true;
+		});
+		auto done = std::make_shared<std::atomic<bool>>(false);
+		connections_.push_back({std::thread([this, fd, done] {
+			handleConnection(fd);
+			close(fd);
+			*done = true;
+		}), done});
+	}
+}
+
+void OffloadServer::handleConnection (int fd)
+{
+	// Requests are received straight into an input buffer, which inference binds without copy
+	std::shared_ptr<LockedBuffer> input = interpreter_.acquireInputBuffer();
+	if (!input) return;
+
+	// Both ends must run the same model: the confidences are indexed by its labels
+	const Hello hello = {kHelloMagic, (uint32_t) interpreter_.getClassLabels().size(), interpreter_.getModelHash()};
+	Hello client;
+	if (!recvAll(fd, &client, sizeof(client), running_) || client.magic != kHelloMagic || !sendAll(fd, &hello, sizeof(hello)))
+		return;
+	if (client.model_hash != hello.model_hash || client.classes != hello.classes) {
+		std::cerr << "Offload client runs another model: closing." << std::endl;
+		return;
+	}
+
+	MessageHeader request;
+	while (recvAll(fd, &request, sizeof(request), running_)) {
+		if (request.magic != kMagic || request.count != input->size()) {
+			std::cerr << "Offload request of " << request.count << " bytes, expected " << input->size() << ": closing." << std::endl;
+			return;
+		}
+		if (!recvAll(fd, input->data(), request.count, running_)) return;
+
+		std::vector<Detection> detections;
+		{
+			std::lock_guard<std::mutex> lock(interpreter_mutex_);
+			detections = interpreter_.runInference(input->data());
+		}
+
+		std::vector<float> confidences(detections.size());
+		for (const Detection &detection : detections)
+			confidences[detection.class_id] = detection.confidence;
+		MessageHeader reply = {kMagic, request.id, (uint32_t) confidences.size()};
+		if (!sendAll(fd, &reply, sizeof(reply)) || !sendAll(fd, confidences.data(), confidences.size() * sizeof(float)))
+			return;
+	}
+}
+
+// --- OffloadClient ---
+
+OffloadClient::OffloadClient (const std::string &host, unsigned short port, std::chrono::milliseconds budget,
+                              uint64_t model_hash, size_t classes) :
+	host_(host),
+	port_(port),
+	budget_(budget),
+	model_hash_(model_hash),
+	classes_(classes),
+	running_(true),
+	fd_(-1),
+	senders_(0),
+	next_id_(0),
+	consecutive_misses_(0),
+	model_mismatch_(false),
+	offloaded_(0),
+	timeouts_(0),
+	fallbacks_(0),
+	bad_replies_(0),
+	rtt_ms_mean_(0)
+{
+	receiver_ = std::thread(&OffloadClient::receive, this);
+}
+
+OffloadClient::~OffloadClient ()
+{
+	running_ = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (fd_ >= 0) shutdown(fd_, SHUT_RDWR);
+	}
+	receiver_.join();
+}
+
+bool OffloadClient::connectHost ()
+{
+	addrinfo hints = {}, *addresses = nullptr;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &addresses) != 0)
+		return false;
+
+	int fd = -1;
+	for (addrinfo *address = addresses; address && fd < 0; address = address->ai_next) {
+		fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+		if (fd < 0) continue;
+		// Sends must not stall a frame longer than its budget
+		timeval timeout = {time_t(budget_.count() / 1000), suseconds_t(budget_.count() % 1000 * 1000)};
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		if (connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addresses);
+	if (fd < 0) return false;
+
+	setNoDelay(fd);
+	const Hello hello = {kHelloMagic, (uint32_t) classes_, model_hash_};
+	Hello host;
+	if (!sendAll(fd, &hello, sizeof(hello)) || !recvAll(fd, &host, sizeof(host), running_) || host.magic != kHelloMagic) {
+		close(fd);
+		return false;
+	}
+	const bool mismatch = host.model_hash != hello.model_hash || host.classes != hello.classes;
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (mismatch) {
+		close(fd);
+		if (!model_mismatch_)
+			std::cerr << "Offload host " << host_ << ":" << port_ << " runs another model, inferring locally." << std::endl;
+		model_mismatch_ = true;
+		return false;
+	}
+	model_mismatch_ = false;
+	fd_ = fd;
+	consecutive_misses_ = 0;
+	std::cout << "Offloading inference to " << host_ << ":" << port_ << std::endl;
+	return true;
+}
+
+// Only the receiver thread closes the socket; the others shut it down to make it notice. It is
+// closed once no sender writes to it any more, so that its number can't be reused under them.
+void OffloadClient::disconnect (std::unique_lock<std::mutex> &lock)
+{
+	if (fd_ >= 0) {
+		const int fd = fd_;
+		fd_ = -1; // new requests fall back
+		shutdown(fd, SHUT_RDWR);
+		idle_.wait(lock, [this] { return senders_ == 0; });
+		close(fd);
+		std::cerr << "Offload host " << host_ << ":" << port_ << " disconnected, inferring locally." << std::endl;
+	}
+	for (auto &pending : pending_)
+		pending.second->done = true; // without confidences: fall back
+	replied_.notify_all();
+}
+
+void OffloadClient::receive ()
+{
+	while (running_) {
+		int fd;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			fd = fd_;
+		}
+		if (fd < 0) {
+			if (!connectHost()) {
+				bool mismatch;
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					mismatch = model_mismatch_;
+				}
+				// Retry every second, a host running another model less often
+				const int tenths = mismatch ? 10 * kSkipPeriod.count() : 10;
+				for (int i = 0; i < tenths && running_; ++i)
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			continue;
+		}
+
+		MessageHeader reply;
+		std::vector<float> confidences;
+		bool ok = recvAll(fd, &reply, sizeof(reply), running_) && reply.magic == kMagic && reply.count * sizeof(float) <= kMaxPayload;
+		if (ok) {
+			confidences.resize(reply.count);
+			ok = recvAll(fd, confidences.data(), reply.count * sizeof(float), running_);
+		}
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (!ok) {
+			disconnect(lock);
+			continue;
+		}
+		auto it = pending_.find(reply.id);
+		if (it == pending_.end()) continue; // given up on, too late
+		it->second->confidences = std::move(confidences);
+		it->second->done = true;
+		replied_.notify_all();
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	disconnect(lock);
+}
+
+bool OffloadClient::infer (const uint8_t *input, size_t bytes, std::vector<Detection> &detections)
+{
+	const Clock::time_point start = Clock::now();
+	Pending pending;
+	uint32_t id;
+	int fd;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (fd_ < 0 || start < skip_until_) {
+			++fallbacks_;
+			return false;
+		}
+		fd = fd_;
+		++senders_;
+		id = next_id_++;
+		pending_[id] = &pending;
+	}
+
+	Tracer::global().begin("offload");
+	bool sent;
+	{
+		std::lock_guard<std::mutex> lock(send_mutex_);
+		MessageHeader request = {kMagic, id, (uint32_t) bytes};
+		sent = sendAll(fd, &request, sizeof(request)) && sendAll(fd, input, bytes);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!sent) shutdown(fd, SHUT_RDWR); // a partial request desynchronizes the stream
+	if (--senders_ == 0) idle_.notify_all();
+	bool replied = sent && replied_.wait_until(lock, start + budget_, [&pending] { return pending.done; });
+	pending_.erase(id);
+	Tracer::global().end("offload");
+
+	// A reply for another number of classes can't be from the same model: not trusted either
+	const bool bad_reply = replied && !pending.confidences.empty() && pending.confidences.size() != classes_;
+	if (!replied || pending.confidences.empty() || bad_reply) {
+		++fallbacks_;
+		if (sent && !replied) ++timeouts_;
+		if (bad_reply) ++bad_replies_;
+		if (++consecutive_misses_ >= kMaxMisses) {
+			skip_until_ = Clock::now() + kSkipPeriod;
+			consecutive_misses_ = 0;
+			std::cerr << "Offload host too slow, inferring locally for " << kSkipPeriod.count() << " s." << std::endl;
+		}
+		return false;
+	}
+
+	consecutive_misses_ = 0;
+	++offloaded_;
+	double rtt_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	rtt_ms_mean_ += (rtt_ms - rtt_ms_mean_) / offloaded_;
+
+	detections.clear();
+	for (size_t class_id = 0; class_id < pending.confidences.size(); ++class_id)
+		detections.push_back(Detection{(int) class_id, pending.confidences[class_id]});
+	return true;
+}
+
+std::string OffloadClient::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::ostringstream json;
+	json
+		<< "{\"host\":\"" << host_ << ":" << port_ << "\""
+		<< ",\"connected\":" << (fd_ >= 0 ? "true" : "false")
+		<< ",\"model_mismatch\":" << (model_mismatch_ ? "true" : "false")
+		<< ",\"skipping\":" << (Clock::now() < skip_until_ ? "true" : "false")
+		<< ",\"budget_ms\":" << budget_.count()
+		<< ",\"offloaded\":" << offloaded_
+		<< ",\"timeouts\":" << timeouts_
+		<< ",\"fallbacks\":" << fallbacks_
+		<< ",\"bad_replies\":" << bad_replies_
+		<< ",\"rtt_ms_mean\":" << rtt_ms_mean_ << "}";
+	return json.str();
+}
@@ -0,0 +1,113 @@
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ModelInterpreter.h"
+
+// Inference offload to a companion host over TCP. The Pi sends preprocessed model inputs
+// (uint8, a few tens of KB) and gets the class confidences back. Messages are a fixed header
+// followed by the payload, in host byte order (both ends are little-endian).
+//
+//   hello:   hello magic, class count, model hash (both ways, once at connect)
+//   request: magic, id, payload bytes, input bytes
+//   reply:   magic, id, confidence count, count × float32
+//
+// A host running another model than the client's is refused at the hello.
+
+// Runs a ModelInterpreter for remote clients (my_interpreter --serve). Each connection is served
+// by its own thread, requests are answered in order; inference itself is serialized.
+class OffloadServer
+{
+public:
+	explicit OffloadServer (ModelInterpreter &interpreter);
+	~OffloadServer ();
+
+	bool start (unsigned short port);
+	void stop  ();
+
+private:
+	ModelInterpreter &interpreter_;
+	std::mutex interpreter_mutex_;
+	int listen_fd_;
+	std::thread thread_;
+	std::atomic<bool> running_;
+
+	struct Connection
+	{
+		std::thread thread;
+		std::shared_ptr<std::atomic<bool>> done;
+	};
+	std::mutex connections_mutex_; // protects connections_
+	std::list<Connection> connections_;
+
+	void serve ();
+	void handleConnection (int fd);
+};
+
+// Client side: requests from any number of threads are pipelined on one connection and matched
+// to their replies by id. A request not answered within the latency budget is given up on (its
+// late reply is dropped) and the caller falls back to local inference; after repeated misses the
+// host is considered slow and skipped for a while. Reconnects in the background.
+class OffloadClient
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// model_hash and classes: of the local model, the host must run the same
+	OffloadClient (const std::string &host, unsigned short port, std::chrono::milliseconds budget,
+	               uint64_t model_hash, size_t classes);
+	~OffloadClient ();
+
+	// Returns false if the host is unavailable, slow or failed: run the inference locally then
+	bool infer (const uint8_t *input, size_t bytes, std::vector<Detection> &detections);
+
+	std::string toJson () const;
+
+private:
+	struct Pending
+	{
+		bool done = false;
+		std::vector<float> confidences;
+	};
+
+	std::string const host_;
+	unsigned short const port_;
+	std::chrono::milliseconds const budget_;
+	uint64_t const model_hash_;
+	size_t const classes_;
+
+	std::thread receiver_;
+	std::atomic<bool> running_;
+
+	mutable std::mutex mutex_; // protects everything below
+	std::condition_variable replied_;
+	int fd_;
+	unsigned senders_;             // infer() calls writing to fd_: it stays open until they are done
+	std::condition_variable idle_; // senders_ fell to 0
+	uint32_t next_id_;
+	std::map<uint32_t, Pending*> pending_;
+	unsigned consecutive_misses_;
+	Clock::time_point skip_until_;
+	bool model_mismatch_; // the host was refused for running another model
+	uint64_t offloaded_, timeouts_, fallbacks_, bad_replies_;
+	double rtt_ms_mean_;
+
+	std::mutex send_mutex_; // serializes writes of whole requests
+
+	void receive ();
+	bool connectHost ();
+	void disconnect (std::unique_lock<std::mutex> &lock);
+};
+
+#endif // OFFLOAD_H
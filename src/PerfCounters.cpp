@@ -0,0 +1,63 @@
+#include "PerfCounters.h"
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+PerfCounters::PerfCounters ()
+{
+	static const struct { uint32_t type; uint64_t config; } events[NumEvents] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+		{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+	};
+
+	// Counters are opened one by one rather than as a group, so a missing PMU event doesn't
+	// take the others down with it (common in VMs and with restrictive perf_event_paranoid)
+	for (int i = 0; i < NumEvents; ++i) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = events[i].type;
+		attr.size = sizeof(attr);
+		attr.config = events[i].config;
+		attr.exclude_kernel = events[i].type == PERF_TYPE_HARDWARE;
+		attr.exclude_hv = 1;
+		fds_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	}
+}
+
+PerfCounters::~PerfCounters ()
+{
+	for (int fd : fds_)
+		if (fd >= 0) close(fd);
+}
+
+unsigned PerfCounters::availableMask () const
+{
+	unsigned mask = 0;
+	for (int i = 0; i < NumEvents; ++i)
+		if (fds_[i] >= 0) mask |= 1u << i;
+	return mask;
+}
+
+PerfCounters::Values PerfCounters::read () const
+{
+	Values values;
+	for (int i = 0; i < NumEvents; ++i) {
+		values[i] = 0;
+		if (fds_[i] >= 0 && ::read(fds_[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+			values[i] = 0;
+	}
+	return values;
+}
+
+const char *PerfCounters::name (Event event)
+{
+	static const char *const names[NumEvents] = {
+		"cycles", "instructions", "cache_misses", "branch_misses", "context_switches", "page_faults"
+	};
+	return names[event];
+}
@@ -0,0 +1,31 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cstdint>
+
+// Hardware and software performance counters of the calling thread, through perf_event_open.
+// Events the kernel or the PMU don't provide are reported as unavailable and read as 0.
+class PerfCounters
+{
+public:
+	enum Event { Cycles, Instructions, CacheMisses, BranchMisses, ContextSwitches, PageFaults, NumEvents };
+	using Values = std::array<uint64_t, NumEvents>;
+
+	 PerfCounters ();
+	~PerfCounters ();
+	PerfCounters (const PerfCounters&) = delete;
+	PerfCounters &operator= (const PerfCounters&) = delete;
+
+	bool available (Event event) const { return fds_[event] >= 0; }
+	bool anyAvailable () const { return availableMask() != 0; }
+	unsigned availableMask () const; // bit i set if Event i is available
+	Values read () const;
+
+	static const char *name (Event event);
+
+private:
+	std::array<int, NumEvents> fds_;
+};
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,117 @@
+#include "PipelineMetrics.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <memory>
+#include <sstream>
+
+PipelineMetrics &PipelineMetrics::global ()
+{
+	static PipelineMetrics metrics;
+	return metrics;
+}
+
+const char *PipelineMetrics::name (Stage stage)
+{
+	static const char *const names[NumStages] = {"capture", "conversion", "preprocess", "invoke", "postprocess"};
+	return names[stage];
+}
+
+void PipelineMetrics::record (Stage stage, Clock::duration latency, const PerfCounters::Values *counters, unsigned counters_mask)
+{
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+	int bucket = 0;
+	for (uint64_t us = ns / 1000; us && bucket < kBuckets - 1; us >>= 1)
+		++bucket;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	StageStats &stats = stages_[stage];
+	++stats.count;
+	stats.total_ns += ns;
+	stats.max_ns = std::max(stats.max_ns, ns);
+	++stats.histogram[bucket];
+	if (counters) {
+		++stats.counted;
+		stats.counters_mask |= counters_mask;
+		for (int i = 0; i < PerfCounters::NumEvents; ++i)
+			stats.counters[i] += (*counters)[i];
+	}
+}
+
+// Upper bound of the histogram bucket holding the p-th percentile, in microseconds
+double PipelineMetrics::percentile (const StageStats &stats, double p)
+{
+	uint64_t rank = std::max<uint64_t>(1, uint64_t(p * stats.count + 0.5)), seen = 0;
+	for (int b = 0; b < kBuckets; ++b) {
+		seen += stats.histogram[b];
+		if (seen >= rank) return double(1ull << b);
+	}
+	return 0;
+}
+
+std::string PipelineMetrics::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::ostringstream json;
+	json << "{";
+	for (int s = 0; s < NumStages; ++s) {
+		const StageStats &stats = stages_[s];
+		json
+			<< (s ? ",\"" : "\"") << name(static_cast<Stage>(s)) << "\":{"
+			<< "\"count\":" << stats.count
+			<< ",\"mean_us\":" << (stats.count ? stats.total_ns / 1e3 / stats.count : 0)
+			<< ",\"max_us\":" << stats.max_ns / 1e3
+			<< ",\"p50_us\":" << (stats.count ? percentile(stats, 0.50) : 0)
+			<< ",\"p99_us\":" << (stats.count ? percentile(stats, 0.99) : 0)
+			<< ",\"threads\":" << threads_[s];
+		if (stats.counted) {
+			// Averages per execution of the stage, on the calling thread only: the work of the
+			// other threads of the stage isn't counted
+			json << ",\"counters_scope\":\"calling_thread\",\"counters\":{";
+			bool first = true;
+			for (int i = 0; i < PerfCounters::NumEvents; ++i) {
+				if (!(stats.counters_mask & (1u << i))) continue;
+				json
+					<< (first ? "\"" : ",\"") << PerfCounters::name(static_cast<PerfCounters::Event>(i)) << "\":"
+					<< double(stats.counters[i]) / stats.counted;
+				first = false;
+			}
+			const uint64_t cycles = stats.counters[PerfCounters::Cycles];
+			if (cycles)
+				json << ",\"ipc\":" << double(stats.counters[PerfCounters::Instructions]) / cycles;
+			json << "}";
+		}
+		json << "}";
+	}
+	json << "}";
+	return json.str();
+}
+
+ScopedStage::ScopedStage (PipelineMetrics::Stage stage) :
+	stage_(stage),
+	counters_(nullptr)
+{
+	if (PipelineMetrics::global().countersEnabled()) {
+		// Counters follow the thread, so each pipeline thread gets its own set
+		thread_local std::unique_ptr<PerfCounters> thread_counters = std::make_unique<PerfCounters>();
+		if (thread_counters->anyAvailable()) {
+			counters_ = thread_counters.get();
+			start_values_ = counters_->read();
+		}
+	}
+	Tracer::global().begin(PipelineMetrics::name(stage_));
+	start_ = PipelineMetrics::Clock::now();
+}
+
+ScopedStage::~ScopedStage ()
+{
+	PipelineMetrics::Clock::duration latency = PipelineMetrics::Clock::now() - start_;
+	Tracer::global().end(PipelineMetrics::name(stage_));
+	if (counters_) {
+		PerfCounters::Values values = counters_->read();
+		for (int i = 0; i < PerfCounters::NumEvents; ++i)
+			values[i] -= start_values_[i];
+		PipelineMetrics::global().record(stage_, latency, &values, counters_->availableMask());
+	} else {
+		PipelineMetrics::global().record(stage_, latency);
+	}
+}
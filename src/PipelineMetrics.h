@@ -0,0 +1,74 @@
+#ifndef PIPELINE_METRICS_H
+#define PIPELINE_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "PerfCounters.h"
+
+// Per-stage latency of the capture→inference pipeline, optionally with hardware counters
+class PipelineMetrics
+{
+public:
+	enum Stage { Capture, Conversion, Preprocess, Invoke, Postprocess, NumStages };
+	using Clock = std::chrono::steady_clock;
+
+	// The metrics shared by the whole pipeline
+	static PipelineMetrics &global ();
+
+	// Counters are sampled around each stage only when enabled (a few syscalls per stage)
+	void enableCounters (bool enable) { counters_enabled_ = enable; }
+	bool countersEnabled () const { return counters_enabled_; }
+
+	// Threads an execution of the stage may run on (e.g. preprocessing workers, TFLite threads).
+	// Counters only cover the thread that runs the stage, so they are exported next to this count.
+	void setThreads (Stage stage, unsigned threads) { threads_[stage] = threads; }
+
+	// counters: deltas over the stage, for the events set in counters_mask
+	void record (Stage stage, Clock::duration latency, const PerfCounters::Values *counters = nullptr, unsigned counters_mask = 0);
+
+	std::string toJson () const;
+	static const char *name (Stage stage);
+
+private:
+	// Latency histogram with power-of-two microsecond buckets: [0,1), [1,2), [2,4)...
+	static constexpr int kBuckets = 32;
+
+	struct StageStats
+	{
+		uint64_t count = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+		std::array<uint64_t, kBuckets> histogram {};
+		uint64_t counted = 0; // samples that carry counters
+		unsigned counters_mask = 0;
+		std::array<uint64_t, PerfCounters::NumEvents> counters {};
+	};
+
+	std::atomic<bool> counters_enabled_ {false};
+	mutable std::mutex mutex_;
+	std::array<StageStats, NumStages> stages_;
+	std::array<std::atomic<unsigned>, NumStages> threads_ {{{1}, {1}, {1}, {1}, {1}}};
+
+	static double percentile (const StageStats &stats, double p);
+};
+
+// Measures the enclosing scope as one execution of a pipeline stage (and traces it, see Tracer)
+class ScopedStage
+{
+public:
+	explicit ScopedStage (PipelineMetrics::Stage stage);
+	~ScopedStage ();
+
+private:
+	PipelineMetrics::Stage const stage_;
+	PipelineMetrics::Clock::time_point start_;
+	PerfCounters *counters_;          // null when counters are disabled
+	PerfCounters::Values start_values_;
+};
+
+#endif // PIPELINE_METRICS_H
@@ -0,0 +1,233 @@
+#include "PizzaAnalytics.h"
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+
+// Labels of the oven workflow, in the order of PizzaAnalytics::State
+static const char *const state_labels[] = {"raw_pizzas", "cooked_pizzas", "pizza_shovel", "everything_else"};
+
+PizzaAnalytics::PizzaAnalytics (const std::vector<std::string> &class_labels, unsigned stable_frames,
+                                const SamplingOptions &sampling) :
+	stable_frames_(std::max(1u, stable_frames)),
+	sampling_(sampling),
+	state_(Unknown),
+	candidate_(Unknown),
+	candidate_frames_(0),
+	state_since_(Clock::now()),
+	start_(state_since_),
+	frames_(0),
+	loaded_(0),
+	unloaded_(0),
+	in_oven_head_(0),
+	in_oven_count_(0),
+	bakes_(0),
+	bake_last_(0),
+	bake_min_(0),
+	bake_max_(0),
+	bake_mean_(0),
+	window_minute_(-1),
+	window_loaded_(0),
+	window_unloaded_(0),
+	peak_hour_unloaded_(0),
+	sampled_(0),
+	skipped_(0)
+{
+	for (int s = 0; s < NumStates; ++s) {
+		auto it = std::find(class_labels.begin(), class_labels.end(), state_labels[s]);
+		state_class_[s] = it != class_labels.end() ? it - class_labels.begin() : -1;
+	}
+	state_seconds_.fill(0);
+	unloaded_by_hour_.fill(0);
+}
+
+PizzaAnalytics::State PizzaAnalytics::stateOf (int class_id) const
+{
+	for (int s = 0; s < NumStates; ++s)
+		if (state_class_[s] == class_id) return static_cast<State>(s);
+	return Unknown;
+}
+
+// Returns the bucket of the current minute, expiring the ones that left the window
+PizzaAnalytics::MinuteBucket &PizzaAnalytics::bucket (Clock::time_point now)
+{
+	int64_t minute = std::chrono::duration_cast<std::chrono::minutes>(now - start_).count();
+	if (minute != window_minute_) {
+		// At most kWindowMinutes buckets to clear, however long the gap was
+		for (int64_t m = std::max(window_minute_ + 1, minute - (int64_t) kWindowMinutes + 1); m <= minute; ++m) {
+			MinuteBucket &b = minutes_[m % kWindowMinutes];
+			window_loaded_   -= b.loaded;
+			window_unloaded_ -= b.unloaded;
+			b = MinuteBucket();
+			b.minute = m;
+		}
+		window_minute_ = minute;
+	}
+	return minutes_[minute % kWindowMinutes];
+}
+
+std::chrono::milliseconds PizzaAnalytics::samplingInterval (Clock::time_point now, const char *&reason) const
+{
+	if (!sampling_.adaptive) {
+		reason = "fixed";
+		return sampling_.fast;
+	}
+	if (state_ == Unknown) {
+		reason = "starting";
+		return sampling_.fast;
+	}
+	if (candidate_ != state_ && candidate_frames_ > 0) { // something changed, confirm it quickly
+		reason = "changing";
+		return sampling_.fast;
+	}
+	if (state_ == Shovel || state_ == Raw) {
+		reason = state_ == Shovel ? "shovel" : "loading";
+		return sampling_.fast;
+	}
+	if (in_oven_count_ == 0) {
+		reason = "waiting";
+		return sampling_.normal;
+	}
+
+	// The oldest pizza in the oven comes out first, not before the shortest bake seen so far
+	const bool measured = bakes_ >= kMinBakes;
+	const double earliest = measured ? bake_min_ : sampling_.bake_seconds;
+	const double expected = measured ? bake_mean_ : sampling_.bake_seconds;
+	const double baked = std::chrono::duration<double>(now - in_oven_[in_oven_head_]).count();
+	if (baked < sampling_.wake_fraction * earliest) {
+		reason = "baking";
+		return sampling_.slow;
+	}
+	if (baked < 2 * expected) {
+		reason = "bake_ending";
+		return sampling_.fast;
+	}
+	reason = "overdue"; // its unload was probably missed
+	return sampling_.normal;
+}
+
+bool PizzaAnalytics::shouldSample (Clock::time_point now)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	const char *reason;
+	if (sampled_ && now - last_sample_ < samplingInterval(now, reason)) {
+		++skipped_;
+		return false;
+	}
+	last_sample_ = now;
+	++sampled_;
+	return true;
+}
+
+void PizzaAnalytics::update (int class_id, float confidence, Clock::time_point now)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	++frames_;
+	bucket(now);
+
+	// Debounce: the scene state only changes after stable_frames_ agreeing frames
+	State observed = stateOf(class_id);
+	if (observed == Unknown || confidence < kMinConfidence) return;
+	if (observed != candidate_) {
+		candidate_ = observed;
+		candidate_frames_ = 0;
+	}
+	if (++candidate_frames_ < stable_frames_ || candidate_ == state_) return;
+
+	if (state_ != Unknown)
+		state_seconds_[state_] += std::chrono::duration<double>(now - state_since_).count();
+	onTransition(state_, candidate_, now);
+	state_ = candidate_;
+	state_since_ = now;
+}
+
+void PizzaAnalytics::onTransition (State from, State to, Clock::time_point now)
+{
+	MinuteBucket &b = bucket(now);
+
+	if (to == Raw) {
+		// A raw pizza at the oven mouth is being loaded
+		++loaded_;
+		++b.loaded;
+		++window_loaded_;
+		if (in_oven_count_ == kMaxInOven) { // forget the oldest, it was never seen coming out
+			in_oven_head_ = (in_oven_head_ + 1) % kMaxInOven;
+			--in_oven_count_;
+		}
+		in_oven_[(in_oven_head_ + in_oven_count_++) % kMaxInOven] = now;
+	} else if (to == Cooked && from != Raw) {
+		// A cooked pizza shows up (usually on the shovel): the oldest one in the oven came out
+		++unloaded_;
+		++b.unloaded;
+		++window_unloaded_;
+		peak_hour_unloaded_ = std::max(peak_hour_unloaded_, window_unloaded_);
+
+		std::time_t wall = std::time(nullptr);
+		std::tm local;
+		localtime_r(&wall, &local);
+		++unloaded_by_hour_[local.tm_hour];
+
+		if (in_oven_count_ > 0) {
+			double bake = std::chrono::duration<double>(now - in_oven_[in_oven_head_]).count();
+			in_oven_head_ = (in_oven_head_ + 1) % kMaxInOven;
+			--in_oven_count_;
+
+			++bakes_;
+			bake_last_ = bake;
+			bake_min_  = bakes_ == 1 ? bake : std::min(bake_min_, bake);
+			bake_max_  = std::max(bake_max_, bake);
+			bake_mean_ += (bake - bake_mean_) / bakes_;
+		}
+	}
+}
+
+std::string PizzaAnalytics::toJson () const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	Clock::time_point now = Clock::now();
+
+	// Include the time spent so far in the current state
+	std::array<double, NumStates> seconds = state_seconds_;
+	if (state_ != Unknown)
+		seconds[state_] += std::chrono::duration<double>(now - state_since_).count();
+
+	// Entries of the rolling window may be stale if no frame arrived for a while
+	int64_t minute = std::chrono::duration_cast<std::chrono::minutes>(now - start_).count();
+	uint32_t last_hour_loaded = 0, last_hour_unloaded = 0;
+	for (const MinuteBucket &b : minutes_) {
+		if (b.minute < 0 || minute - b.minute >= (int64_t) kWindowMinutes) continue;
+		last_hour_loaded   += b.loaded;
+		last_hour_unloaded += b.unloaded;
+	}
+
+	std::ostringstream json;
+	json
+		<< "{\"uptime_s\":" << std::chrono::duration<double>(now - start_).count()
+		<< ",\"frames\":" << frames_
+		<< ",\"state\":\"" << (state_ != Unknown ? state_labels[state_] : "unknown") << "\""
+		<< ",\"state_for_s\":" << std::chrono::duration<double>(now - state_since_).count()
+		<< ",\"pizzas_loaded\":" << loaded_
+		<< ",\"pizzas_unloaded\":" << unloaded_
+		<< ",\"pizzas_in_oven\":" << in_oven_count_
+		<< ",\"idle_s\":" << seconds[Empty]
+		<< ",\"bake_s\":{\"count\":" << bakes_
+		<< ",\"last\":" << bake_last_
+		<< ",\"min\":" << bake_min_
+		<< ",\"max\":" << bake_max_
+		<< ",\"mean\":" << bake_mean_ << "}"
+		<< ",\"last_hour\":{\"loaded\":" << last_hour_loaded << ",\"unloaded\":" << last_hour_unloaded << "}"
+		<< ",\"peak_hour_unloaded\":" << peak_hour_unloaded_
+		<< ",\"unloaded_by_hour\":[";
+	for (size_t h = 0; h < unloaded_by_hour_.size(); ++h)
+		json << (h ? "," : "") << unloaded_by_hour_[h];
+	json << "],\"state_s\":{";
+	for (int s = 0; s < NumStates; ++s)
+		json << (s ? ",\"" : "\"") << state_labels[s] << "\":" << seconds[s];
+	const char *reason;
+	json
+		<< "},\"sampling\":{\"interval_ms\":" << samplingInterval(now, reason).count()
+		<< ",\"reason\":\"" << reason << "\""
+		<< ",\"sampled\":" << sampled_
+		<< ",\"skipped\":" << skipped_
+		<< ",\"sampled_ratio\":" << (sampled_ ? double(sampled_) / (sampled_ + skipped_) : 0) << "}}";
+	return json.str();
+}
@@ -0,0 +1,105 @@
+#ifndef PIZZA_ANALYTICS_H
+#define PIZZA_ANALYTICS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Sampling rates of the workflow states: frames are classified at most once per interval
+struct SamplingOptions
+{
+	bool   adaptive      = true;
+	std::chrono::milliseconds fast   {0};    // shovel present, state changing, bake ending: every frame
+	std::chrono::milliseconds normal {200};  // empty oven mouth, waiting for a pizza to be loaded
+	std::chrono::milliseconds slow   {1000}; // pizzas baking, nothing due
+	double bake_seconds  = 90;   // expected bake until enough bakes have been measured
+	double wake_fraction = 0.8;  // of the shortest bake, when sampling speeds up again
+};
+
+// Turns the stream of per-frame classifications into oven workflow metrics.
+// Every update is O(1): the scene state is debounced, and the rolling windows are fixed ring buffers.
+class PizzaAnalytics
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// stable_frames: consecutive frames a label must win before the scene state changes
+	PizzaAnalytics (const std::vector<std::string> &class_labels, unsigned stable_frames = 3,
+	                const SamplingOptions &sampling = SamplingOptions());
+
+	// Whether a frame captured now should be classified, given the workflow state and the time
+	// elapsed in it: slow while pizzas bake, fast near their expected completion and around the shovel.
+	// Any frame disagreeing with the state switches to fast until it's confirmed or dismissed.
+	bool shouldSample (Clock::time_point now = Clock::now());
+	void update (int class_id, float confidence, Clock::time_point now = Clock::now());
+
+	std::string toJson () const;
+
+private:
+	enum State { Unknown = -1, Raw, Cooked, Shovel, Empty, NumStates };
+
+	static constexpr unsigned kWindowMinutes = 60; // rolling throughput window
+	static constexpr unsigned kMaxInOven     = 16; // pizzas tracked between load and unload
+	static constexpr float    kMinConfidence = 0.5f; // less confident frames don't vote
+	static constexpr uint64_t kMinBakes      = 3;    // measured bakes before trusting their mean
+
+	struct MinuteBucket
+	{
+		int64_t  minute   = -1;
+		uint32_t loaded   = 0;
+		uint32_t unloaded = 0;
+	};
+
+	mutable std::mutex mutex_;
+	std::array<int, NumStates> state_class_; // class id for each state, -1 if not in the labels
+	unsigned const stable_frames_;
+	SamplingOptions const sampling_;
+
+	// Debouncing
+	State    state_;
+	State    candidate_;
+	unsigned candidate_frames_;
+	Clock::time_point state_since_;
+	Clock::time_point start_;
+
+	// Counters
+	uint64_t frames_;
+	uint64_t loaded_;
+	uint64_t unloaded_;
+	std::array<double, NumStates> state_seconds_;
+
+	// Pizzas currently in the oven (FIFO of load times)
+	std::array<Clock::time_point, kMaxInOven> in_oven_;
+	unsigned in_oven_head_;
+	unsigned in_oven_count_;
+
+	// Bake durations
+	uint64_t bakes_;
+	double   bake_last_;
+	double   bake_min_;
+	double   bake_max_;
+	double   bake_mean_;
+
+	// Rolling last-hour throughput and its peak
+	std::array<MinuteBucket, kWindowMinutes> minutes_;
+	int64_t  window_minute_;
+	uint32_t window_loaded_;
+	uint32_t window_unloaded_;
+	uint32_t peak_hour_unloaded_;
+	std::array<uint32_t, 24> unloaded_by_hour_; // by local hour of day
+
+	// Adaptive sampling
+	Clock::time_point last_sample_;
+	uint64_t sampled_;
+	uint64_t skipped_;
+
+	State stateOf (int class_id) const;
+	std::chrono::milliseconds samplingInterval (Clock::time_point now, const char *&reason) const;
+	MinuteBucket &bucket (Clock::time_point now);
+	void onTransition (State from, State to, Clock::time_point now);
+};
+
+#endif // PIZZA_ANALYTICS_H
@@ -0,0 +1,232 @@
+#include "Preview.h"
+#include <algorithm>
+#include <cctype>
+#include <turbojpeg.h>
+
+// Colors in limited-range YUV (BT.601)
+struct YuvColor { uint8_t y, u, v; };
+static const YuvColor kWhite  = {235, 128, 128};
+static const YuvColor kBlack  = {16, 128, 128};
+static const YuvColor kGray   = {150, 128, 128};
+static const YuvColor kGreen  = {145, 54, 34};
+
+// 5×7 font, one byte per column (bit 0 at the top), for ' ' to '_'; lower case is drawn upper case
+static const uint8_t kFont[][5] = {
+	{0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14}, // ' ' ! " #
+	{0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00}, // $ % & '
+	{0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, {0x14,0x08,0x3E,0x08,0x14}, {0x08,0x08,0x3E,0x08,0x08}, // ( ) * +
+	{0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02}, // , - . /
+	{0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31}, // 0 1 2 3
+	{0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03}, // 4 5 6 7
+	{0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00}, // 8 9 : ;
+	{0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06}, // < = > ?
+	{0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22}, // @ A B C
+	{0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x01,0x01}, {0x3E,0x41,0x41,0x51,0x32}, // D E F G
+	{0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41}, // H I J K
+	{0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x04,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E}, // L M N O
+	{0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31}, // P Q R S
+	{0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F}, {0x1F,0x20,0x40,0x20,0x1F}, {0x7F,0x20,0x18,0x20,0x7F}, // T U V W
+	{0x63,0x14,0x08,0x14,0x63}, {0x03,0x04,0x78,0x04,0x03}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00}, // X Y Z [
+	{0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40}, // \ ] ^ _
+};
+
+// Drawing on an NV12 image; chroma is written for the 2×2 blocks a shape covers
+class Nv12Canvas
+{
+public:
+	Nv12Canvas (uint8_t *data, int width, int height) :
+		y_(data), uv_(data + width * height), width_(width), height_(height) {}
+
+	void fill (int x, int y, int w, int h, YuvColor color)
+	{
+		int x0 = std::max(0, x), y0 = std::max(0, y);
+		int x1 = std::min(width_, x + w), y1 = std::min(height_, y + h);
+		for (int row = y0; row < y1; ++row)
+			std::fill(y_ + row * width_ + x0, y_ + row * width_ + std::max(x0, x1), color.y);
+		for (int row = y0 / 2; row < (y1 + 1) / 2; ++row)
+			for (int col = x0 / 2; col < (x1 + 1) / 2; ++col) {
+				uv_[row * width_ + 2 * col]     = color.u;
+				uv_[row * width_ + 2 * col + 1] = color.v;
+			}
+	}
+
+	// Luma only, so that the text is readable on any background box
+	int text (int x, int y, const std::string &text, int scale, uint8_t luma)
+	{
+		for (char c : text) {
+			unsigned index = unsigned(std::toupper((unsigned char) c)) - ' ';
+			if (index >= sizeof(kFont) / sizeof(kFont[0])) index = '?' - ' ';
+			for (int col = 0; col < 5; ++col)
+				for (int row = 0; row < 7; ++row)
+					if (kFont[index][col] >> row & 1)
+						for (int dy = 0; dy < scale; ++dy)
+							for (int dx = 0; dx < scale; ++dx) {
+								int px = x + col * scale + dx, py = y + row * scale + dy;
+								if (px >= 0 && px < width_ && py >= 0 && py < height_)
+									y_[py * width_ + px] = luma;
+							}
+			x += 6 * scale;
+		}
+		return x;
+	}
+
+	static int textWidth (const std::string &text, int scale) {return int(text.size()) * 6 * scale;}
+
+private:
+	uint8_t *y_, *uv_;
+	int width_, height_;
+};
+
+// 2× downscale with 2×2 averaging, NV12 to NV12
+static void halveNV12 (const CameraFrame &frame, uint8_t *dst, int width, int height)
+{
+	const uint8_t *src_y = frame.data.data(), *src_uv = src_y + frame.stride * frame.height;
+	uint8_t *dst_uv = dst + width * height;
+	for (int y = 0; y < height; ++y) {
+		const uint8_t *row0 = src_y + 2 * y * frame.stride, *row1 = row0 + frame.stride;
+		for (int x = 0; x < width; ++x)
+			dst[y * width + x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+	}
+	for (int y = 0; y < height / 2; ++y) {
+		const uint8_t *row0 = src_uv + 2 * y * frame.stride, *row1 = row0 + frame.stride;
+		for (int x = 0; x < width / 2; ++x)
+			for (int c = 0; c < 2; ++c)
+				dst_uv[y * width + 2 * x + c] = (row0[4 * x + c] + row0[4 * x + 2 + c] + row1[4 * x + c] + row1[4 * x + 2 + c] + 2) >> 2;
+	}
+}
+
+// Packed 3-channel image to NV12, taking every step-th pixel (2 for a 2× downscale)
+static void packedToNV12 (const uint8_t *src, int stride, int step, bool bgr, uint8_t *dst, int width, int height)
+{
+	uint8_t *dst_uv = dst + width * height;
+	const int ri = bgr ? 2 : 0, bi = bgr ? 0 : 2;
+	for (int y = 0; y < height; ++y) {
+		const uint8_t *row = src + step * y * stride;
+		for (int x = 0; x < width; ++x) {
+			const uint8_t *p = row + 3 * step * x;
+			int r = p[ri], g = p[1], b = p[bi];
+			dst[y * width + x] = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+			if ((x | y) & 1) continue;
+			dst_uv[y / 2 * width + x]     = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			dst_uv[y / 2 * width + x + 1] = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+	}
+}
+
+Preview::Preview (const std::vector<std::string> &class_labels) :
+	class_labels_(class_labels)
+{
+}
+
+Preview::~Preview ()
+{
+	if (jpeg_encoder_) tjDestroy(jpeg_encoder_);
+}
+
+bool Preview::wanted () const
+{
+	return always_wanted_ || Clock::now().time_since_epoch().count() < wanted_until_;
+}
+
+void Preview::update (const CameraFrame &frame, const FrameResult &result)
+{
+	if (!wanted()) return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	width_  = frame.width / 4 * 2; // even, for the chroma plane
+	height_ = frame.height / 4 * 2;
+	nv12_.resize(width_ * height_ * 3 / 2);
+	if (frame.format == FrameFormat::NV12) {
+		halveNV12(frame, nv12_.data(), width_, height_);
+	} else if (frame.format == FrameFormat::BGR) {
+		packedToNV12(frame.data.data(), frame.stride, 2, true, nv12_.data(), width_, height_);
+	} else {
+		// Raw: demosaiced by 2×2 binning, already the preview size
+		if (!tone_map_.matches(frame.raw))
+			makeRawToneMap(tone_map_, frame.raw);
+		const int binned_width = frame.width / 2;
+		rgb_.resize(binned_width * (frame.height / 2) * 3);
+		bayerToRGBBinned(frame.data.data(), frame.format, frame.width, frame.stride, 2, tone_map_, rgb_.data(), 0, height_);
+		packedToNV12(rgb_.data(), binned_width * 3, 1, false, nv12_.data(), width_, height_);
+	}
+	drawOverlay(result);
+	++frames_;
+	updated_.notify_all();
+}
+
+void Preview::drawOverlay (const FrameResult &result)
+{
+	Nv12Canvas canvas(nv12_.data(), width_, height_);
+
+	// Winning label, large, top left
+	if (result.class_id >= 0 && result.class_id < (int) class_labels_.size()) {
+		std::string title = class_labels_[result.class_id] + " " + std::to_string(int(result.confidence * 100 + 0.5f)) + "%";
+		canvas.fill(0, 0, Nv12Canvas::textWidth(title, 2) + 8, 22, kBlack);
+		canvas.text(4, 4, title, 2, kWhite.y);
+	}
+
+	// Confidence bars of every class, bottom left
+	const int row_height = 10, label_width = 6 * 15, bar_width = std::max(0, width_ - label_width - 12);
+	int y = height_ - 4 - row_height * (int) result.detections.size();
+	for (const Detection &detection : result.detections) {
+		const std::string label = detection.class_id < (int) class_labels_.size() ? class_labels_[detection.class_id].substr(0, 14) : "?";
+		canvas.fill(0, y, width_, row_height, kBlack);
+		canvas.text(4, y + 1, label, 1, kWhite.y);
+		canvas.fill(label_width + 4, y + 2, int(bar_width * std::min(1.f, std::max(0.f, detection.confidence))), row_height - 4,
+			detection.class_id == result.class_id ? kGreen : kGray);
+		y += row_height;
+	}
+}
+
+bool Preview::latest (std::vector<uint8_t> &nv12, int &width, int &height)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (nv12_.empty()) return false;
+	nv12 = nv12_;
+	width = width_;
+	height = height_;
+	return true;
+}
+
+std::string Preview::jpeg (int quality)
+{
+	// Keeps the previews coming for a few seconds, a viewer usually polls
+	const Clock::time_point now = Clock::now();
+	const bool was_wanted = wanted();
+	wanted_until_ = (now + std::chrono::seconds(5)).time_since_epoch().count();
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!was_wanted || nv12_.empty()) { // the last one is stale: wait for a fresh one
+		uint64_t frames = frames_;
+		updated_.wait_for(lock, std::chrono::seconds(1), [this, frames] { return frames_ != frames; });
+	}
+	if (nv12_.empty()) return std::string();
+	// Encoded from a copy, so that update() (on the inference path) never waits for the encoder
+	const std::vector<uint8_t> nv12 = nv12_;
+	const int width = width_, height = height_;
+	lock.unlock();
+
+	// TurboJPEG wants planar YUV: only the small chroma plane is deinterleaved
+	const int chroma_width = width / 2, chroma_height = height / 2;
+	std::vector<uint8_t> u(chroma_width * chroma_height), v(u.size());
+	const uint8_t *uv = nv12.data() + width * height;
+	for (size_t i = 0; i < u.size(); ++i) {
+		u[i] = uv[2 * i];
+		v[i] = uv[2 * i + 1];
+	}
+	const unsigned char *planes[3] = {nv12.data(), u.data(), v.data()};
+	const int strides[3] = {width, chroma_width, chroma_width};
+
+	std::lock_guard<std::mutex> encoder_lock(jpeg_mutex_);
+	if (!jpeg_encoder_) jpeg_encoder_ = tjInitCompress();
+	unsigned char *jpeg = nullptr;
+	unsigned long size = 0;
+	if (!jpeg_encoder_
+		|| tjCompressFromYUVPlanes(jpeg_encoder_, planes, width, strides, height, TJSAMP_420, &jpeg, &size, quality, TJFLAG_FASTDCT) != 0) {
+		if (jpeg) tjFree(jpeg);
+		return std::string();
+	}
+	std::string result(reinterpret_cast<const char*>(jpeg), size);
+	tjFree(jpeg);
+	return result;
+}
@@ -0,0 +1,59 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CameraFrame.h"
+#include "FramePipeline.h"
+#include "Kernels.h"
+
+// Annotated preview of the camera, for whoever is looking: the frame is downscaled 2× in NV12,
+// and the label and confidence bars are drawn in the NV12 planes. Nothing is copied unless
+// a viewer asked recently, and it is only converted (window) or encoded (JPEG) for that viewer.
+class Preview
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit Preview (const std::vector<std::string> &class_labels);
+	~Preview ();
+
+	// A viewer is always there (local window), instead of only after requests
+	void setAlwaysWanted (bool wanted) {always_wanted_ = wanted;}
+
+	// Called for every classified frame, cheap when nobody is watching
+	void update (const CameraFrame &frame, const FrameResult &result);
+
+	// Latest preview, NV12 (width × height, then the UV plane); false if there is none yet
+	bool latest (std::vector<uint8_t> &nv12, int &width, int &height);
+	// Latest preview as a JPEG, waiting up to a second for one if needed; empty on failure
+	std::string jpeg (int quality = 75);
+
+private:
+	std::vector<std::string> const class_labels_;
+	std::atomic<bool> always_wanted_{false};
+	std::atomic<int64_t> wanted_until_{0}; // Clock ticks, pushed forward by each request
+
+	std::mutex jpeg_mutex_; // protects jpeg_encoder_, encoding outside of mutex_
+	void *jpeg_encoder_ = nullptr; // tjhandle
+
+	std::mutex mutex_; // protects everything below
+	std::condition_variable updated_;
+	std::vector<uint8_t> nv12_;
+	int width_  = 0;
+	int height_ = 0;
+	uint64_t frames_ = 0;
+	RawToneMap tone_map_;          // raw frames are demosaiced for the preview too
+	std::vector<uint8_t> rgb_;
+
+	bool wanted () const;
+	void drawOverlay (const FrameResult &result);
+};
+
+#endif // PREVIEW_H
@@ -0,0 +1,238 @@
+// Python bindings of the deployed preprocessing and inference path, for dataset-scale
+// evaluation in the training notebook with results identical to the device.
+//
+//   make python   # builds raspizza$(python3-config --extension-suffix), needs pybind11
+//
+//   import numpy as np, raspizza
+//   model = raspizza.Interpreter("../models/my_model.tflite", "../models/labels.txt")
+//   tensor = model.preprocess(nv12, raspizza.FrameFormat.NV12)  # (h, w, 3) uint8 model input
+//   class_id, confidence, probabilities = model.classify(nv12, raspizza.FrameFormat.NV12)
+//
+// Arrays are passed and returned without copy: frames are read in place (any row stride,
+// contiguous rows), preprocessed inputs are views of the pooled input buffers bound to the
+// input tensor, and outputs take over the dequantized vectors. The GIL is released while
+// preprocessing and inferring, so a thread pool of Interpreter objects scales across cores.
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "CameraFrame.h"
+#include "FramePipeline.h"
+#include "ModelInterpreter.h"
+
+namespace py = pybind11;
+
+using U8Array = py::array_t<uint8_t, py::array::forcecast>;
+
+// NumPy array owning a heap object, released with the array
+template <typename T, typename Owner>
+static py::array_t<T> ownedArray (std::vector<py::ssize_t> shape, T *data, Owner *owner)
+{
+	py::capsule release(owner, [] (void *p) { delete static_cast<Owner*>(p); });
+	return py::array_t<T>(shape, data, release);
+}
+
+static py::array_t<float> toArray (std::vector<float> &&values)
+{
+	auto *owner = new std::vector<float>(std::move(values));
+	return ownedArray<float>({py::ssize_t(owner->size())}, owner->data(), owner);
+}
+
+// Describes a NumPy frame: NV12 as (height × 3/2, width), BGR as (height, width, 3)
+static FrameView frameView (const U8Array &array, FrameFormat format, uint32_t sequence)
+{
+	py::buffer_info info = array.request();
+	FrameView view;
+	view.data = static_cast<const uint8_t*>(info.ptr);
+	view.format = format;
+	view.sequence = sequence;
+	if (format == FrameFormat::NV12) {
+		if (info.ndim != 2 || info.shape[0] % 3 || info.strides[1] != 1)
+			throw std::invalid_argument("NV12 frames must be (height * 3 / 2, width) uint8 arrays with contiguous rows");
+		view.width  = info.shape[1];
+		view.height = info.shape[0] * 2 / 3;
+	} else {
+		if (info.ndim != 3 || info.shape[2] != 3 || info.strides[2] != 1 || info.strides[1] != 3)
+			throw std::invalid_argument("BGR frames must be (height, width, 3) uint8 arrays with contiguous rows");
+		view.width  = info.shape[1];
+		view.height = info.shape[0];
+	}
+	view.stride = info.strides[0];
+	return view;
+}
+
+// ModelInterpreter with its FramePipeline. Calls are serialized, one object per Python thread
+// to run in parallel.
+class PyInterpreter
+{
+public:
+	PyInterpreter (const std::string &model_file, const std::string &label_file, int num_threads, const std::string &signature_key)
+	{
+		ModelOptions options;
+		options.model_file = model_file;
+		options.label_file = label_file;
+		options.num_threads = num_threads;
+		options.signature_key = signature_key;
+		if (!interpreter_.init(options))
+			throw std::runtime_error("Failed to initialize the interpreter with " + model_file);
+		pipeline_ = std::make_unique<FramePipeline>(interpreter_);
+	}
+
+	// Model input, exactly as FramePipeline prepares it on the device
+	py::array_t<uint8_t> preprocess (const U8Array &frame, FrameFormat format)
+	{
+		FrameView view = frameView(frame, format, 0);
+		auto input = std::make_unique<PreparedInput>();
+		bool prepared;
+		{
+			py::gil_scoped_release release;
+			std::lock_guard<std::mutex> lock(mutex_);
+			prepared = pipeline_->preprocess(view, *input);
+		}
+		if (!prepared)
+			throw std::runtime_error("Failed to preprocess the frame");
+		uint8_t *data = input->buffer->data();
+		std::vector<py::ssize_t> shape = {py::ssize_t(interpreter_.getInputHeight()), py::ssize_t(interpreter_.getInputWidth()), 3};
+		return ownedArray<uint8_t>(shape, data, input.release());
+	}
+
+	// Conversion, preprocessing and inference: (class_id, confidence, probabilities)
+	py::tuple classify (const U8Array &frame, FrameFormat format)
+	{
+		FrameView view = frameView(frame, format, 0);
+		FrameResult result;
+		bool prepared, inferred = false;
+		{
+			py::gil_scoped_release release;
+			std::lock_guard<std::mutex> lock(mutex_);
+			PreparedInput input;
+			prepared = pipeline_->preprocess(view, input);
+			if (prepared)
+				inferred = pipeline_->infer(input, result);
+		}
+		if (!prepared)
+			throw std::runtime_error("Failed to preprocess the frame");
+		if (!inferred)
+			throw std::runtime_error("Failed to run the inference");
+		return py::make_tuple(result.class_id, result.confidence, probabilities(result.detections));
+	}
+
+	// Inference on an already preprocessed (height, width, 3) uint8 input. It is copied to a pooled
+	// input buffer: the input tensor stays bound to it after the call, and NumPy memory may be gone by then.
+	py::array_t<float> run (const U8Array &input)
+	{
+		py::buffer_info info = input.request();
+		if (info.ndim != 3 || info.shape[0] != interpreter_.getInputHeight() || info.shape[1] != interpreter_.getInputWidth()
+			|| info.shape[2] != 3 || info.strides[0] != info.shape[1] * 3 || info.strides[1] != 3)
+			throw std::invalid_argument("Input must be a contiguous (height, width, 3) uint8 array of the model input size");
+		std::vector<Detection> detections;
+		{
+			py::gil_scoped_release release;
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::shared_ptr<LockedBuffer> buffer = interpreter_.acquireInputBuffer();
+			if (buffer) {
+				std::memcpy(buffer->data(), info.ptr, buffer->size());
+				detections = interpreter_.runInference(buffer->data());
+			}
+		}
+		if (detections.empty())
+			throw std::runtime_error("Failed to run the inference");
+		return probabilities(detections);
+	}
+
+	// Generic access for multi-input/multi-output models
+	void setInput (int input, const py::array_t<float, py::array::c_style | py::array::forcecast> &values)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!interpreter_.setInput(input, values.data(), values.size()))
+			throw std::invalid_argument("Failed to set input " + std::to_string(input));
+	}
+
+	void invoke ()
+	{
+		bool invoked;
+		{
+			py::gil_scoped_release release;
+			std::lock_guard<std::mutex> lock(mutex_);
+			invoked = interpreter_.invoke();
+		}
+		if (!invoked)
+			throw std::runtime_error("Failed to invoke the interpreter");
+	}
+
+	py::array_t<float> getOutput (int output)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (output < 0 || output >= (int) interpreter_.getOutputs().size())
+			throw std::out_of_range("No output " + std::to_string(output));
+		return toArray(interpreter_.getOutput(output));
+	}
+
+	const ModelInterpreter &interpreter () const {return interpreter_;}
+
+private:
+	ModelInterpreter interpreter_;
+	std::unique_ptr<FramePipeline> pipeline_;
+	std::mutex mutex_;
+
+	py::array_t<float> probabilities (const std::vector<Detection> &detections) const
+	{
+		std::vector<float> values(interpreter_.getClassLabels().size());
+		for (const Detection &detection : detections)
+			if (detection.class_id >= 0 && detection.class_id < (int) values.size())
+				values[detection.class_id] = detection.confidence;
+		return toArray(std::move(values));
+	}
+};
+
+static py::dict tensorInfo (const TensorInfo &info)
+{
+	py::dict result;
+	result["name"] = info.name;
+	result["type"] = TfLiteTypeGetName(info.type);
+	result["shape"] = info.shape;
+	result["bytes"] = info.bytes;
+	result["scale"] = info.scale;
+	result["zero_point"] = info.zero_point;
+	return result;
+}
+
+PYBIND11_MODULE(raspizza, m)
+{
+	m.doc() = "Deployed preprocessing and TFLite inference path of the pizza oven monitor";
+
+	py::enum_<FrameFormat>(m, "FrameFormat")
+		.value("NV12", FrameFormat::NV12)
+		.value("BGR", FrameFormat::BGR);
+
+	py::class_<PyInterpreter>(m, "Interpreter")
+		.def(py::init<const std::string&, const std::string&, int, const std::string&>(),
+			py::arg("model_file"), py::arg("label_file"), py::arg("num_threads") = ModelOptions().num_threads, py::arg("signature_key") = "")
+		.def("preprocess", &PyInterpreter::preprocess, py::arg("frame"), py::arg("format") = FrameFormat::NV12)
+		.def("classify", &PyInterpreter::classify, py::arg("frame"), py::arg("format") = FrameFormat::NV12)
+		.def("run", &PyInterpreter::run, py::arg("input"))
+		.def("set_input", &PyInterpreter::setInput, py::arg("input"), py::arg("values"))
+		.def("invoke", &PyInterpreter::invoke)
+		.def("get_output", &PyInterpreter::getOutput, py::arg("output"))
+		.def_property_readonly("input_width", [] (const PyInterpreter &self) { return self.interpreter().getInputWidth(); })
+		.def_property_readonly("input_height", [] (const PyInterpreter &self) { return self.interpreter().getInputHeight(); })
+		.def_property_readonly("labels", [] (const PyInterpreter &self) { return self.interpreter().getClassLabels(); })
+		.def_property_readonly("inputs", [] (const PyInterpreter &self) {
+			py::list inputs;
+			for (const TensorInfo &info : self.interpreter().getInputs()) inputs.append(tensorInfo(info));
+			return inputs;
+		})
+		.def_property_readonly("outputs", [] (const PyInterpreter &self) {
+			py::list outputs;
+			for (const TensorInfo &info : self.interpreter().getOutputs()) outputs.append(tensorInfo(info));
+			return outputs;
+		});
+}
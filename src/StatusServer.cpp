@@ -0,0 +1,135 @@
+#include "StatusServer.h"
+#include <iostream>
+#include <cstring>
+#include <sstream>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+StatusServer::StatusServer () :
+	listen_fd_(-1),
+	running_(false)
+{
+}
+
+StatusServer::~StatusServer ()
+{
+	stop();
+}
+
+void StatusServer::addEndpoint (const std::string &path, std::function<std::string()> handler, const std::string &content_type)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	endpoints_[path] = Endpoint{std::move(handler), content_type};
+}
+
+bool StatusServer::start (unsigned short port)
+{
+	listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd_ < 0) {
+		std::cerr << "Failed to create status socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	int one = 1;
+	setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	// Only reachable from the device itself
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd_, 4) != 0) {
+		std::cerr << "Failed to listen on status port " << port << ": " << strerror(errno) << std::endl;
+		close(listen_fd_);
+		listen_fd_ = -1;
+		return false;
+	}
+
+	running_ = true;
+	thread_ = std::thread(&StatusServer::serve, this);
+	std::cout << "Status endpoint: http://127.0.0.1:" << port << "/" << std::endl;
+	return true;
+}
+
+void StatusServer::stop ()
+{
+	running_ = false;
+	if (thread_.joinable()) thread_.join();
+	if (listen_fd_ >= 0) close(listen_fd_);
+	listen_fd_ = -1;
+}
+
+void StatusServer::serve ()
+{
+	while (running_) {
+		// Wake up regularly to notice stop()
+		pollfd pfd = {listen_fd_, POLLIN, 0};
+		if (poll(&pfd, 1, 200) <= 0) continue;
+
+		int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) continue;
+		handleClient(fd);
+		close(fd);
+	}
+}
+
+void StatusServer::handleClient (int fd)
+{
+	// Only the request line matters: "GET /path HTTP/1.1"
+	char request[1024];
+	size_t length = 0;
+	while (length < sizeof(request) - 1) {
+		pollfd pfd = {fd, POLLIN, 0};
+		if (poll(&pfd, 1, 1000) <= 0) return;
+		ssize_t n = recv(fd, request + length, sizeof(request) - 1 - length, 0);
+		if (n <= 0) return;
+		length += n;
+		request[length] = '\0';
+		if (strstr(request, "\r\n")) break;
+	}
+
+	std::istringstream line(request);
+	std::string method, path;
+	line >> method >> path;
+	path = path.substr(0, path.find('?'));
+
+	int code = 200;
+	std::string body, content_type = "application/json";
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = endpoints_.find(path);
+		if (method != "GET") {
+			code = 405;
+			body = "{\"error\":\"method not allowed\"}";
+		} else if (it != endpoints_.end()) {
+			body = it->second.handler();
+			content_type = it->second.content_type;
+		} else if (path == "/") {
+			// Index of the available documents
+			body = "{\"endpoints\":[";
+			for (auto e = endpoints_.begin(); e != endpoints_.end(); ++e)
+				body += (e == endpoints_.begin() ? "\"" : ",\"") + e->first + "\"";
+			body += "]}";
+		} else {
+			code = 404;
+			body = "{\"error\":\"not found\"}";
+		}
+	}
+
+	std::ostringstream response;
+	response
+		<< "HTTP/1.1 " << code << (code == 200 ? " OK" : code == 404 ? " Not Found" : " Method Not Allowed") << "\r\n"
+		<< "Content-Type: " << content_type << "\r\n"
+		<< "Content-Length: " << body.size() << "\r\n"
+		<< "Connection: close\r\n\r\n"
+		<< body;
+	std::string data = response.str();
+	for (size_t sent = 0; sent < data.size(); ) {
+		ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) break;
+		sent += n;
+	}
+}
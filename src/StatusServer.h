@@ -0,0 +1,42 @@
+#ifndef STATUS_SERVER_H
+#define STATUS_SERVER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Minimal HTTP server on the loopback interface, serving JSON status documents (and the preview)
+class StatusServer
+{
+public:
+	 StatusServer ();
+	~StatusServer ();
+
+	// Registers the handler producing the document served at path (e.g. "/analytics")
+	void addEndpoint (const std::string &path, std::function<std::string()> handler,
+	                  const std::string &content_type = "application/json");
+
+	bool start (unsigned short port);
+	void stop  ();
+
+private:
+	int listen_fd_;
+	std::thread thread_;
+	std::atomic<bool> running_;
+
+	struct Endpoint
+	{
+		std::function<std::string()> handler;
+		std::string content_type;
+	};
+	std::mutex mutex_; // protects endpoints_
+	std::map<std::string, Endpoint> endpoints_;
+
+	void serve ();
+	void handleClient (int fd);
+};
+
+#endif // STATUS_SERVER_H
@@ -0,0 +1,148 @@
+#include "Tracer.h"
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static thread_local uint64_t current_frame = 0;
+
+Tracer &Tracer::global ()
+{
+	static Tracer tracer;
+	return tracer;
+}
+
+void Tracer::setFrame (uint64_t sequence)
+{
+	current_frame = sequence;
+}
+
+Tracer::ThreadBuffer &Tracer::threadBuffer ()
+{
+	// Buffers stay owned by the tracer, so events of exited threads can still be dumped
+	thread_local ThreadBuffer *buffer = nullptr;
+	if (!buffer) {
+		auto shared = std::make_shared<ThreadBuffer>();
+		shared->tid = syscall(SYS_gettid);
+		std::lock_guard<std::mutex> lock(mutex_);
+		threads_.push_back(shared);
+		buffer = shared.get();
+	}
+	return *buffer;
+}
+
+void Tracer::record (const char *name, char phase)
+{
+	ThreadBuffer &buffer = threadBuffer();
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	Event &event = buffer.events[head & (kCapacity - 1)];
+	event.seq_begin.store(head + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.name.store(name, std::memory_order_relaxed);
+	event.ts_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(),
+		std::memory_order_relaxed);
+	event.frame.store(current_frame, std::memory_order_relaxed);
+	event.phase.store(phase, std::memory_order_relaxed);
+	event.seq_end.store(head + 1, std::memory_order_release);
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::begin (const char *name)
+{
+	if (enabled()) record(name, 'B');
+}
+
+void Tracer::end (const char *name)
+{
+	if (enabled()) record(name, 'E');
+}
+
+// An event read out of its slot
+struct TracedEvent
+{
+	uint64_t    index;
+	const char *name;
+	uint64_t    ts_ns;
+	uint64_t    frame;
+	char        phase;
+};
+
+std::string Tracer::toJson () const
+{
+	std::vector<std::shared_ptr<ThreadBuffer>> threads;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		threads = threads_;
+	}
+
+	std::ostringstream json;
+	json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	int pid = getpid();
+	for (const auto &buffer : threads) {
+		// Copy the most recent events, skipping any slot the writer was in the middle of
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t begin = head > kCapacity ? head - kCapacity : 0;
+		std::vector<TracedEvent> events;
+		events.reserve(head - begin);
+		for (uint64_t i = begin; i < head; ++i) {
+			const Event &event = buffer->events[i & (kCapacity - 1)];
+			const uint64_t seq = event.seq_end.load(std::memory_order_acquire);
+			TracedEvent copy {i, event.name.load(std::memory_order_relaxed), event.ts_ns.load(std::memory_order_relaxed),
+				event.frame.load(std::memory_order_relaxed), event.phase.load(std::memory_order_relaxed)};
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq == i + 1 && event.seq_begin.load(std::memory_order_relaxed) == seq)
+				events.push_back(copy);
+		}
+		// Then drop the ones overwritten meanwhile: the writer may be filling event new_head, in the
+		// slot of event new_head - kCapacity
+		uint64_t new_head = buffer->head.load(std::memory_order_acquire);
+		if (new_head >= begin + kCapacity) begin = new_head - kCapacity + 1;
+
+		for (const TracedEvent &event : events) {
+			if (event.index < begin) continue;
+			json
+				<< (first ? "" : ",")
+				<< "{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase << "\""
+				<< ",\"ts\":" << event.ts_ns / 1000 << "." << (event.ts_ns % 1000) / 100
+				<< ",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+				<< ",\"args\":{\"frame\":" << event.frame << "}}";
+			first = false;
+		}
+	}
+	json << "]}";
+	return json.str();
+}
+
+bool Tracer::dump (const std::string &path) const
+{
+	std::ofstream file(path);
+	file << toJson();
+	if (!file) {
+		std::cerr << "Failed to write trace to: " << path << std::endl;
+		return false;
+	}
+	std::cout << "Trace written to: " << path << std::endl;
+	return true;
+}
+
+void Tracer::dumpOnSignal (const std::string &prefix)
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+	std::thread([this, prefix, set] {
+		for (unsigned n = 0; ; ++n) {
+			int signal;
+			if (sigwait(&set, &signal) != 0) return;
+			dump(prefix + "-" + std::to_string(n) + ".json");
+		}
+	}).detach();
+}
@@ -0,0 +1,66 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records begin/end events of the pipeline stages into per-thread ring buffers, and dumps them
+// in the Chrome trace event JSON format (loads in chrome://tracing and in the Perfetto UI).
+// Recording is lock-free: each thread only ever writes its own buffer.
+class Tracer
+{
+public:
+	static Tracer &global ();
+
+	void enable (bool enable) { enabled_ = enable; }
+	bool enabled () const { return enabled_.load(std::memory_order_relaxed); }
+
+	// Frame sequence number attached to the next events of the calling thread
+	static void setFrame (uint64_t sequence);
+
+	// name must be a string literal (or otherwise outlive the tracer)
+	void begin (const char *name);
+	void end   (const char *name);
+
+	std::string toJson () const;
+	bool dump (const std::string &path) const;
+
+	// Dumps a trace to "<prefix>-<n>.json" on every SIGUSR1. Must be called before any other
+	// thread is started, since SIGUSR1 gets blocked in all of them and handled by a dedicated thread.
+	void dumpOnSignal (const std::string &prefix);
+
+private:
+	static constexpr size_t kCapacity = 1 << 14; // events per thread, a power of two
+
+	// A slot is written as a seqlock: its event number + 1 before and after the payload, so a dump
+	// racing with the writer sees two different numbers and skips it
+	struct Event
+	{
+		std::atomic<uint64_t>     seq_begin;
+		std::atomic<const char *> name;
+		std::atomic<uint64_t>     ts_ns;
+		std::atomic<uint64_t>     frame;
+		std::atomic<char>         phase; // 'B' or 'E'
+		std::atomic<uint64_t>     seq_end;
+	};
+
+	struct ThreadBuffer
+	{
+		int tid;
+		std::atomic<uint64_t> head {0}; // total events written
+		Event events[kCapacity];
+	};
+
+	std::atomic<bool> enabled_ {false};
+	mutable std::mutex mutex_; // protects threads_ (registration and dumps only)
+	std::vector<std::shared_ptr<ThreadBuffer>> threads_;
+
+	ThreadBuffer &threadBuffer ();
+	void record (const char *name, char phase);
+};
+
+#endif // TRACER_H
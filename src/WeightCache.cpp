@@ -0,0 +1,68 @@
+#include "WeightCache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <sys/auxv.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+static const char kSuffix[] = ".xnnpack";
+
+std::string cpuFeaturesKey ()
+{
+	utsname name;
+	const char *machine = uname(&name) == 0 ? name.machine : "unknown";
+	char key[96];
+	snprintf(key, sizeof(key), "%s_%lx_%lx", machine, getauxval(AT_HWCAP), getauxval(AT_HWCAP2));
+	return key;
+}
+
+uint64_t hashModel (const void *data, size_t size)
+{
+	// FNV-1a over 64-bit words: detects any change of the file, fast enough to run at every start
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = 0xcbf29ce484222325ull ^ size;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * 0x100000001b3ull;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+std::string weightCachePath (const std::string &dir, const std::string &model_file, uint64_t model_hash)
+{
+	if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+		std::cerr << "Failed to create " << dir << ": " << strerror(errno) << std::endl;
+
+	size_t slash = model_file.rfind('/');
+	std::string model_name = model_file.substr(slash == std::string::npos ? 0 : slash + 1);
+	model_name = model_name.substr(0, model_name.rfind('.'));
+	char key[32];
+	snprintf(key, sizeof(key), "%016llx", (unsigned long long) model_hash);
+	const std::string file = model_name + "-" + key + "-" + cpuFeaturesKey() + kSuffix;
+
+	// Caches of the same model name but another hash or CPU are stale
+	const size_t hash_end = model_name.size() + 1 + 16;
+	if (DIR *entries = opendir(dir.c_str())) {
+		while (dirent *entry = readdir(entries)) {
+			const std::string name = entry->d_name;
+			const bool same_model = name.size() > hash_end + sizeof(kSuffix) && name.compare(0, model_name.size() + 1, model_name + "-") == 0
+				&& name.find_first_not_of("0123456789abcdef", model_name.size() + 1) == hash_end && name[hash_end] == '-'
+				&& name.compare(name.size() - sizeof(kSuffix) + 1, std::string::npos, kSuffix) == 0;
+			if (same_model && name != file) {
+				std::cout << "Removing stale weight cache " << name << std::endl;
+				unlink((dir + "/" + name).c_str());
+			}
+		}
+		closedir(entries);
+	}
+	return dir + "/" + file;
+}
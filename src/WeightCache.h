@@ -0,0 +1,23 @@
+#ifndef WEIGHT_CACHE_H
+#define WEIGHT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Persistent cache of the weights XNNPACK repacks for its kernels, so that interpreter creation
+// maps them from a file instead of repacking on every start. A cache file is only valid for one
+// model and one set of CPU features, which its name carries:
+//
+//   <dir>/<model name>-<model hash>-<cpu features>.xnnpack
+
+// Identifies the CPU features the packing depends on (architecture and hwcaps)
+std::string cpuFeaturesKey ();
+// 64-bit hash of the model file's contents
+uint64_t hashModel (const void *data, size_t size);
+
+// Path of the cache of a model in dir (created if needed). The caches of other versions of the
+// model, or from other CPUs, are removed: a model change can't reuse stale weights.
+std::string weightCachePath (const std::string &dir, const std::string &model_file, uint64_t model_hash);
+
+#endif // WEIGHT_CACHE_H
@@ -0,0 +1,67 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool (unsigned threads)
+{
+	for (unsigned i = 0; i < threads; ++i)
+		threads_.emplace_back(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool ()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	work_ready_.notify_all();
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+void WorkerPool::parallelFor (int count, const std::function<void(int)> &task)
+{
+	if (threads_.empty() || count <= 1) {
+		for (int i = 0; i < count; ++i)
+			task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> call_lock(call_mutex_);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		task_ = &task;
+		count_ = count;
+		next_ = 0;
+		active_ = threads_.size();
+		++generation_;
+	}
+	work_ready_.notify_all();
+
+	runTasks();
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	work_done_.wait(lock, [this] { return active_ == 0; });
+	task_ = nullptr;
+}
+
+void WorkerPool::runTasks ()
+{
+	// Tasks are claimed one at a time, so that a preempted thread doesn't hold up the others
+	for (int i; (i = next_++) < count_; )
+		(*task_)(i);
+}
+
+void WorkerPool::workerLoop ()
+{
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		work_ready_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+		if (stop_) return;
+		seen = generation_;
+
+		lock.unlock();
+		runTasks();
+		lock.lock();
+		if (--active_ == 0) work_done_.notify_one();
+	}
+}
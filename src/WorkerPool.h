@@ -0,0 +1,45 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops on the frame path (e.g. preprocessing
+// bands). The calling thread takes part in the work, so a pool of N threads uses N + 1 cores.
+class WorkerPool
+{
+public:
+	explicit WorkerPool (unsigned threads);
+	~WorkerPool ();
+
+	// Runs task(0) ... task(count - 1) across the workers and the caller, and returns when all
+	// are done. Concurrent calls are serialized.
+	void parallelFor (int count, const std::function<void(int)> &task);
+
+	// Threads taking part in parallelFor(), the caller included
+	unsigned concurrency () const {return threads_.size() + 1;}
+
+private:
+	std::vector<std::thread> threads_;
+	std::mutex call_mutex_;
+
+	std::mutex mutex_; // protects everything below
+	std::condition_variable work_ready_;
+	std::condition_variable work_done_;
+	const std::function<void(int)> *task_ = nullptr;
+	int count_ = 0;
+	std::atomic<int> next_{0};
+	unsigned active_ = 0;     // workers still running the current loop
+	uint64_t generation_ = 0; // incremented for each loop
+	bool stop_ = false;
+
+	void workerLoop ();
+	void runTasks   ();
+};
+
+#endif // WORKER_POOL_H
@@ -2,88 +2,407 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <fstream>
 
 #include "ModelInterpreter.h"
 #include "CameraHandler.h"
+#include "DriftMonitor.h"
+#include "FrameFile.h"
+#include "FramePipeline.h"
+#include "IdleMonitor.h"
+#include "InferenceScheduler.h"
+#include "Offload.h"
+#include "PipelineMetrics.h"
+#include "PizzaAnalytics.h"
+#include "Preview.h"
+#include "StatusServer.h"
+#include "WorkerPool.h"
+#include "Tracer.h"
 
+#ifdef WITH_OPENCV
 #include <opencv2/opencv.hpp>
+#endif
 
 
 std::unique_ptr<ModelInterpreter> model_interpreter_ptr; // must be accessible from the callback
+std::unique_ptr<FramePipeline> frame_pipeline_ptr;
+std::unique_ptr<PizzaAnalytics> pizza_analytics_ptr;
+std::unique_ptr<DriftMonitor> drift_monitor_ptr;
+std::unique_ptr<IdleMonitor> idle_monitor_ptr; // null unless the idle mode is enabled
+std::unique_ptr<Preview> preview_ptr;
+bool show_preview = false;
+std::ofstream frame_dump; // open with --dump-frames
+int frames_to_dump = 32;
+CameraHandler *camera_handler_ptr = nullptr;
+// Inference of both models, off the capture thread; the safety model (optional) preempts the queue
+std::unique_ptr<ModelInterpreter> safety_interpreter_ptr;
+std::unique_ptr<FramePipeline> safety_pipeline_ptr;
+std::unique_ptr<InferenceScheduler> scheduler_ptr;
+int pizza_lane = -1, safety_lane = -1;
+
+// Pizza-state classification of a frame, on a scheduler thread
+void onPizzaResult (const CameraFrame &frame, const FrameResult &result)
+{
+	const std::vector<std::string> &class_labels = model_interpreter_ptr->getClassLabels();
+	std::cout << "detections.size(): " << result.detections.size() << std::endl;
+	for (const Detection &detection : result.detections)
+		std::cout << class_labels[detection.class_id] << ": " << detection.confidence << std::endl;
+	if (drift_monitor_ptr)
+		drift_monitor_ptr->update(result.detections);
+	if (result.class_id >= 0) {
+		std::cout << "Object detected: " << class_labels[result.class_id] << std::endl << std::endl;
+		if (pizza_analytics_ptr)
+			pizza_analytics_ptr->update(result.class_id, result.confidence);
+	}
+
+	// Annotated preview, drawn in NV12 only while someone is watching
+	if (preview_ptr)
+		preview_ptr->update(frame, result);
+#ifdef WITH_OPENCV
+	if (show_preview) {
+		// The small annotated NV12 preview is the only thing converted for display
+		std::vector<uint8_t> nv12;
+		int width, height;
+		if (preview_ptr->latest(nv12, width, height)) {
+			cv::Mat bgr_image;
+			cv::cvtColor(cv::Mat(height + height / 2, width, CV_8UC1, nv12.data()), bgr_image, cv::COLOR_YUV2BGR_NV12);
+			cv::imshow("Object (C++)", bgr_image);
+			cv::waitKey(1);
+		}
+	}
+#endif
+}
 
 // This function will be called by CameraHandler when a new frame is ready:
 void processFrameAndInfer (const CameraFrame &frame)
 {
-	if (!model_interpreter_ptr) {
+	if (!frame_pipeline_ptr || !scheduler_ptr) {
 		std::cerr << "Interpreter not initialized!" << std::endl;
 		return;
 	}
 
-	// Input size of TFLite model
-	int model_input_w = model_interpreter_ptr->getInputWidth();
-	int model_input_h = model_interpreter_ptr->getInputHeight();
-
-	// Converts CameraFrame to cv::Mat for resizing
-	// Let's assume that CameraFrame::data is in BGR from CameraHandler
-	cv::Mat original_image_bgr(frame.height, frame.width, CV_8UC3, (void*) frame.data.data());
-
-	// Resize the image at the model input
-	cv::Mat resized_image_bgr;
-	cv::resize(original_image_bgr, resized_image_bgr, cv::Size(model_input_w, model_input_h));
-
-	// Swap the color endianness. OpenCV uses BGR, but TFLite uses RGB:
-	cv::cvtColor(resized_image_bgr, resized_image_bgr, cv::COLOR_BGR2RGB);
-
-	// Perform inference
-	auto start_infer = std::chrono::high_resolution_clock::now();
-	std::vector<Detection> detections = model_interpreter_ptr->runInference(resized_image_bgr.data);
-	auto end_infer = std::chrono::high_resolution_clock::now();
-	auto infer_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_infer - start_infer);
-	std::cout << "Inference time: " << infer_duration.count() << " ms" << std::endl;
-
-	std::vector<std::string> class_labels = model_interpreter_ptr->getClassLabels();
-	int argmax = 0;
-	double max_confidence = 0;
-	std::cout << "detections.size(): " << detections.size() << std::endl;
-	for (size_t i = 0; i < detections.size(); ++i) {
-		std::cout << class_labels[detections[i].class_id] << ": " << detections[i].confidence << std::endl;
-		if (detections[i].confidence > max_confidence) {
-			max_confidence = detections[i].confidence;
-			argmax = i;
-		}
+	// Recording of the first frames, to replay them offline (e.g. my_loadgen --replay)
+	if (frame_dump.is_open() && frames_to_dump > 0) {
+		writeFrame(frame_dump, frame);
+		if (--frames_to_dump == 0) frame_dump.close();
+	}
+
+	// Dark or closed shop: minimum frame rate and no inference until the scene changes
+	if (idle_monitor_ptr) {
+		bool idle = idle_monitor_ptr->update(frame);
+		if (camera_handler_ptr) camera_handler_ptr->setIdle(idle);
+		if (idle) return;
+	}
+
+	Tracer::global().begin("process_frame");
+
+	// Preprocessing here, inference queued to the scheduler: the safety model first
+	std::shared_ptr<const CameraFrame> retained = frame.shared_from_this();
+	PreparedInput input;
+	if (safety_pipeline_ptr && safety_pipeline_ptr->preprocess(frame, input)) {
+		scheduler_ptr->submit(safety_lane, std::move(input), [](const FrameResult &result, bool ran) {
+			if (ran && result.class_id >= 0)
+				std::cout << "Safety: " << safety_interpreter_ptr->getClassLabels()[result.class_id]
+					<< " (" << result.confidence << ")" << std::endl;
+		});
+	}
+	// Pizza state at the rate its workflow needs (the safety model sees every frame)
+	if (pizza_analytics_ptr->shouldSample() && frame_pipeline_ptr->preprocess(frame, input)) {
+		auto start_infer = std::chrono::high_resolution_clock::now();
+		scheduler_ptr->submit(pizza_lane, std::move(input), [retained, start_infer](const FrameResult &result, bool ran) {
+			if (!ran) return; // expired or superseded by newer frames
+			auto infer_duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start_infer);
+			std::cout << "Inference time (queue included): " << infer_duration.count() << " ms" << std::endl;
+			onPizzaResult(*retained, result);
+		});
 	}
-	std::cout << "Object detected: " << class_labels[argmax] << std::endl << std::endl;
 
-	// Show image:
-	cv::imshow("Object (C++)", original_image_bgr);
-	cv::waitKey(1);
+	Tracer::global().end("process_frame");
 }
 
 
-int main ()
+int main (int argc, char **argv)
 {
+	const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
 	const int camera_width  = 640;
 	const int camera_height = 480;
+	const unsigned short status_port = 8090;
+	ModelOptions model_options;
+	model_options.weight_cache_dir = "model/cache";
+	IdleOptions idle_options;
+	bool idle_mode = false;
+	bool raw_capture = false;
+	float roi[4] = {0, 0, 1, 1};
+	bool crop_to_roi = false;
+	std::string dma_heap; // empty: libcamera allocates the capture buffers
+	CaptureRead capture_read = CaptureRead::Auto;
+	std::string drift_reference_file;
+	int preprocess_threads = std::max(1u, std::thread::hardware_concurrency()); // caller included
+	int serve_port = 0;
+	std::string offload_host;
+	unsigned short offload_port = 8091;
+	int offload_budget_ms = 40;
+	ModelOptions safety_options; // no safety model unless --safety-model
+	safety_options.model_file.clear();
+	int inference_threads = 0; // 0: one per model
+	SamplingOptions sampling_options;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--perf-counters")) {
+			// Hardware counters of the thread running each pipeline stage, exported with the latencies
+			PipelineMetrics::global().enableCounters(true);
+		} else if (!strcmp(argv[i], "--trace")) {
+			// Per-frame stage timeline, dumped on SIGUSR1 or served on the status endpoint
+			Tracer::global().enable(true);
+		} else if (!strcmp(argv[i], "--lock-memory")) {
+			// Tensor arena and frame buffers pre-faulted, locked in RAM and on huge pages if possible
+			model_options.lock_memory = true;
+			setMemoryLocking(true);
+		} else if (!strcmp(argv[i], "--weight-cache") && i + 1 < argc) {
+			// Directory of the XNNPACK packed weights kept between starts ("none": repacked at every start)
+			model_options.weight_cache_dir = strcmp(argv[i + 1], "none") ? argv[i + 1] : "";
+			++i;
+		} else if (!strcmp(argv[i], "--delta-inference")) {
+			// Experimental: early layers recomputed only for the changed tiles (model with stem/tail signatures)
+			model_options.delta.enabled = true;
+		} else if (!strcmp(argv[i], "--delta-threshold") && i + 1 < argc) {
+			// Pixel difference below which a tile counts as unchanged (0: exact, but sensor noise changes everything)
+			model_options.delta.pixel_threshold = std::max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--early-exit")) {
+			// Multi-exit model (segment0, segment1... signatures): stops at the first confident head
+			model_options.early_exit.enabled = true;
+		} else if (!strcmp(argv[i], "--exit-thresholds") && i + 1 < argc) {
+			// Confidence for exiting early: one for all classes, or by label (e.g. everything_else=0.8,pizza_shovel=0.97)
+			const char *thresholds = argv[++i];
+			if (strchr(thresholds, '=') ? !parseClassThresholds(thresholds, model_options.early_exit.class_thresholds)
+			                            : (model_options.early_exit.threshold = atof(thresholds)) <= 0) {
+				std::cerr << "Invalid exit thresholds: " << thresholds << std::endl;
+				return -1;
+			}
+		} else if (!strcmp(argv[i], "--idle")) {
+			// Idle when the oven area stays dark: minimum frame rate and no inference
+			idle_mode = true;
+		} else if (!strcmp(argv[i], "--open-hours") && i + 1 < argc) {
+			// Also idle outside opening hours, e.g. 11:00-14:30,18:00-23:30 (implies --idle)
+			if (!parseOpenHours(argv[++i], idle_options.open_hours)) {
+				std::cerr << "Invalid opening hours: " << argv[i] << std::endl;
+				return -1;
+			}
+			idle_mode = true;
+		} else if (!strcmp(argv[i], "--raw")) {
+			// Raw Bayer capture, demosaiced and downscaled on the CPU straight to the model input (no ISP)
+			raw_capture = true;
+		} else if (!strcmp(argv[i], "--roi") && i + 1 < argc) {
+			// The ISP crops to this region (x,y,width,height of the field of view, 0..1), e.g. the oven mouth
+			if (sscanf(argv[++i], "%f,%f,%f,%f", &roi[0], &roi[1], &roi[2], &roi[3]) != 4 || roi[2] <= 0 || roi[3] <= 0) {
+				std::cerr << "Invalid ROI: " << argv[i] << std::endl;
+				return -1;
+			}
+			crop_to_roi = true;
+		} else if (!strcmp(argv[i], "--dma-heap") && i + 1 < argc) {
+			// Capture buffers from a dma-heap of ours: "default" (the contiguous heap), "system", "system-uncached"...
+			dma_heap = argv[++i];
+		} else if (!strcmp(argv[i], "--capture-read") && i + 1 < argc) {
+			// Reads of the capture buffers: auto (measured at startup), direct or staged
+			const char *read = argv[++i];
+			capture_read = !strcmp(read, "direct") ? CaptureRead::Direct : !strcmp(read, "staged") ? CaptureRead::Staged : CaptureRead::Auto;
+		} else if (!strcmp(argv[i], "--dump-frames") && i + 1 < argc) {
+			// Records the first 32 captured frames to a file
+			frame_dump.open(argv[++i], std::ios::binary);
+			if (!frame_dump) {
+				std::cerr << "Failed to create " << argv[i] << std::endl;
+				return -1;
+			}
+		} else if (!strcmp(argv[i], "--preview")) {
+			// Local preview window (needs OpenCV); /preview.jpg is always served
+			show_preview = true;
+		} else if (!strcmp(argv[i], "--fixed-sampling")) {
+			// Classifies every frame instead of following the oven workflow (slow while baking...)
+			sampling_options.adaptive = false;
+		} else if (!strcmp(argv[i], "--preprocess-threads") && i + 1 < argc) {
+			// Cores sharing the conversion and resize of each frame (1: serial)
+			preprocess_threads = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--safety-model") && i + 1 < argc) {
+			// Safety model (e.g. hand near the oven mouth), inferred before any queued pizza-state frame
+			safety_options.model_file = argv[++i];
+		} else if (!strcmp(argv[i], "--safety-labels") && i + 1 < argc) {
+			safety_options.label_file = argv[++i];
+		} else if (!strcmp(argv[i], "--inference-threads") && i + 1 < argc) {
+			// Models inferred concurrently; with 2 or more, one is kept for the safety model
+			inference_threads = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--drift-reference") && i + 1 < argc) {
+			// Output distribution at deployment: loaded if the file exists, saved once captured otherwise
+			drift_reference_file = argv[++i];
+		} else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+			// Companion host: infers for the Pis offloading to it, no camera
+			serve_port = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--offload") && i + 1 < argc) {
+			// Inference on a companion host (HOST[:PORT]), local when it's slow or absent
+			offload_host = argv[++i];
+			size_t colon = offload_host.rfind(':');
+			if (colon != std::string::npos) {
+				offload_port = atoi(offload_host.c_str() + colon + 1);
+				offload_host.resize(colon);
+			}
+		} else if (!strcmp(argv[i], "--offload-budget") && i + 1 < argc) {
+			// Longest wait for the host, in ms, before inferring locally
+			offload_budget_ms = std::max(1, atoi(argv[++i]));
+		} else {
+			std::cerr
+				<< "Usage: " << argv[0] << " [--perf-counters] [--trace] [--lock-memory] [--idle] [--open-hours HH:MM-HH:MM,...]\n"
+				<< "       [--weight-cache DIR|none] [--delta-inference [--delta-threshold N]]\n"
+				<< "       [--early-exit [--exit-thresholds T|LABEL=T,...]]\n"
+				<< "       [--raw] [--roi X,Y,W,H] [--dma-heap HEAP] [--capture-read auto|direct|staged]\n"
+				<< "       [--dump-frames FILE] [--preview] [--preprocess-threads N] [--drift-reference FILE]\n"
+				<< "       [--fixed-sampling] [--safety-model FILE [--safety-labels FILE]] [--inference-threads N]\n"
+				<< "       [--offload HOST[:PORT]] [--offload-budget MS] | --serve PORT" << std::endl;
+			return -1;
+		}
+	}
+	if (Tracer::global().enabled())
+		Tracer::global().dumpOnSignal("raspizza-trace");  // before any other thread is started
 
 	// Initialize the model interpreter
 	model_interpreter_ptr = std::make_unique<ModelInterpreter>();
-	if (!model_interpreter_ptr->init()) {
+	if (!model_interpreter_ptr->init(model_options)) {
 		std::cerr << "Failed to initialize Model's Interpreter." << std::endl;
 		return -1;
 	}
+	const std::chrono::steady_clock::time_point model_ready = std::chrono::steady_clock::now();
+
+	if (serve_port > 0) {
+		OffloadServer offload_server(*model_interpreter_ptr);
+		if (!offload_server.start(serve_port)) return -1;
+		std::cout << "Serving... Press Enter to stop." << std::endl;
+		std::string line;
+		std::getline(std::cin, line);
+		offload_server.stop();
+		return 0;
+	}
+
+	if (!safety_options.model_file.empty()) {
+		safety_options.lock_memory = model_options.lock_memory;
+		safety_options.weight_cache_dir = model_options.weight_cache_dir;
+		safety_interpreter_ptr = std::make_unique<ModelInterpreter>();
+		if (!safety_interpreter_ptr->init(safety_options)) {
+			std::cerr << "Failed to initialize the safety model." << std::endl;
+			return -1;
+		}
+	}
+
+	// Frames are preprocessed on the capture thread, then inferred by other pipelines (sharing the
+	// interpreters) on the scheduler threads
+	WorkerPool preprocess_workers(preprocess_threads - 1);
+	frame_pipeline_ptr = std::make_unique<FramePipeline>(*model_interpreter_ptr, &preprocess_workers);
+	FramePipeline pizza_inference(*model_interpreter_ptr);
+	std::unique_ptr<OffloadClient> offload_client;
+	if (!offload_host.empty()) {
+		offload_client = std::make_unique<OffloadClient>(offload_host, offload_port, std::chrono::milliseconds(offload_budget_ms),
+		                                                 model_interpreter_ptr->getModelHash(),
+		                                                 model_interpreter_ptr->getClassLabels().size());
+		pizza_inference.setOffload(offload_client.get());
+	}
+	std::unique_ptr<FramePipeline> safety_inference;
+	if (safety_interpreter_ptr) {
+		safety_pipeline_ptr = std::make_unique<FramePipeline>(*safety_interpreter_ptr, &preprocess_workers);
+		safety_inference = std::make_unique<FramePipeline>(*safety_interpreter_ptr);
+	}
+	PipelineMetrics::global().setThreads(PipelineMetrics::Preprocess, preprocess_threads);
+	PipelineMetrics::global().setThreads(PipelineMetrics::Invoke, model_options.num_threads);
+	scheduler_ptr = std::make_unique<InferenceScheduler>(inference_threads ? inference_threads : safety_interpreter_ptr ? 2 : 1);
+	LaneOptions pizza_options;
+	pizza_options.name = "pizza";
+	pizza_options.priority = 0;
+	pizza_options.deadline = std::chrono::milliseconds(1000); // a stale pizza state is worthless
+	pizza_options.max_queued = 2;
+	pizza_lane = scheduler_ptr->addLane(pizza_inference, pizza_options);
+	if (safety_inference) {
+		LaneOptions lane_options;
+		lane_options.name = "safety";
+		lane_options.priority = 1;
+		lane_options.deadline = std::chrono::milliseconds(100);
+		lane_options.drop_expired = false; // late is still better than never
+		safety_lane = scheduler_ptr->addLane(*safety_inference, lane_options);
+	}
+
+	// Workflow metrics, served on the local status endpoint
+	pizza_analytics_ptr = std::make_unique<PizzaAnalytics>(model_interpreter_ptr->getClassLabels(), 3, sampling_options);
+	drift_monitor_ptr = std::make_unique<DriftMonitor>(drift_reference_file); // always on, O(1) per frame
+	StatusServer status_server;
+	status_server.addEndpoint("/analytics", [] { return pizza_analytics_ptr->toJson(); });
+	status_server.addEndpoint("/drift", [] { return drift_monitor_ptr->toJson(); });
+	if (offload_client) {
+		OffloadClient *client = offload_client.get();
+		status_server.addEndpoint("/offload", [client] { return client->toJson(); });
+	}
+	status_server.addEndpoint("/scheduler", [] { return scheduler_ptr->toJson(); });
+	status_server.addEndpoint("/metrics", [] { return PipelineMetrics::global().toJson(); });
+	if (model_options.delta.enabled)
+		status_server.addEndpoint("/delta", [] { return model_interpreter_ptr->getDeltaJson(); });
+	if (model_options.early_exit.enabled)
+		status_server.addEndpoint("/early_exit", [] { return model_interpreter_ptr->getEarlyExitJson(); });
+	status_server.addEndpoint("/trace", [] { return Tracer::global().toJson(); });
+	status_server.addEndpoint("/memory", [] {
+		const ModelMemoryReport &report = model_interpreter_ptr->getMemoryReport();
+		return "{\"arena_bytes\":" + std::to_string(report.arena_bytes)
+			+ ",\"persistent_bytes\":" + std::to_string(report.persistent_bytes)
+			+ ",\"io_bytes\":" + std::to_string(report.io_bytes)
+			+ ",\"locked\":" + (report.locked ? "true" : "false")
+			+ ",\"huge_page_bytes\":" + std::to_string(report.huge_page_bytes)
+			+ ",\"warmup_minor_faults\":" + std::to_string(report.minor_faults)
+			+ ",\"warmup_major_faults\":" + std::to_string(report.major_faults) + "}";
+	});
+	status_server.addEndpoint("/boot", [] {
+		const ModelBootReport &report = model_interpreter_ptr->getBootReport();
+		std::string json = "{\"model_init_ms\":" + std::to_string(report.total_ms) + ",\"phases_ms\":{";
+		for (size_t i = 0; i < report.phases_ms.size(); ++i)
+			json += (i ? ",\"" : "\"") + std::string(report.phases_ms[i].first) + "\":" + std::to_string(report.phases_ms[i].second);
+		return json + "},\"weight_cache\":\"" + report.weight_cache + "\""
+			+ ",\"weight_cache_hit\":" + (report.weight_cache_hit ? "true" : "false")
+			+ ",\"weight_cache_bytes\":" + std::to_string(report.weight_cache_bytes) + "}";
+	});
+	preview_ptr = std::make_unique<Preview>(model_interpreter_ptr->getClassLabels());
+	preview_ptr->setAlwaysWanted(show_preview);
+	status_server.addEndpoint("/preview.jpg", [] { return preview_ptr->jpeg(); }, "image/jpeg");
+	if (idle_mode) {
+		idle_monitor_ptr = std::make_unique<IdleMonitor>(idle_options);
+		status_server.addEndpoint("/idle", [] { return idle_monitor_ptr->toJson(); });
+	}
+	if (!status_server.start(status_port))
+		std::cerr << "Status endpoint disabled." << std::endl;
 
 	// Initialize the camera handler with the callback
 	CameraHandler camera_handler(processFrameAndInfer);
-	if (!camera_handler.init(camera_width, camera_height)) {
+	if (!dma_heap.empty() && !camera_handler.setDmaHeap(dma_heap == "default" ? "" : dma_heap)) {
+		std::cerr << "Failed to open the dma-heap." << std::endl;
+		return -1;
+	}
+	camera_handler.setCaptureRead(capture_read);
+	if (!camera_handler.init(camera_width, camera_height, raw_capture)) {
 		std::cerr << "Failed to initialize CameraHandler." << std::endl;
 		return -1;
 	}
 
+	camera_handler_ptr = &camera_handler;
+	if (crop_to_roi)
+		camera_handler.setRoi(roi[0], roi[1], roi[2], roi[3]);
+
 	if (!camera_handler.start()) {
 		std::cerr << "Failed to start camera handler." << std::endl;
 		return -1;
 	}
 
+	// Boot timeline: model_init has the details of the interpreter creation (weights packed or mapped)
+	auto ms = [] (std::chrono::steady_clock::duration duration) {return std::chrono::duration<double, std::milli>(duration).count();};
+	const std::chrono::steady_clock::time_point ready = std::chrono::steady_clock::now();
+	std::cout
+		<< "Boot: model " << ms(model_ready - boot) << " ms (" << model_interpreter_ptr->getBootReport().total_ms << " ms in init"
+		<< (model_interpreter_ptr->getBootReport().weight_cache_hit ? ", cached weights" : "") << ")"
+		<< ", pipelines and camera " << ms(ready - model_ready) << " ms, ready after " << ms(ready - boot) << " ms" << std::endl;
+
 	std::cout << "Running... Press Enter to stop." << std::endl;
 	{	// the main thread doesn't actually do anything...
 		std::string line;
@@ -92,6 +411,11 @@ int main ()
 
 	std::cout << "Stopping camera and cleaning up..." << std::endl;
 	camera_handler.stop();
+	camera_handler_ptr = nullptr;
+	std::cout << "Scheduler: " << scheduler_ptr->toJson() << std::endl;
+	status_server.stop();
+	scheduler_ptr.reset(); // drops the queued jobs, before the pipelines go away
+	std::cout << "Pipeline metrics: " << PipelineMetrics::global().toJson() << std::endl;
 
 	std::cout << "Program terminated." << std::endl;
 	return 0;
@@ -0,0 +1,233 @@
+// C API of libraspizza, on top of CameraHandler, FramePipeline and ModelInterpreter
+#include "raspizza.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include "CameraHandler.h"
+#include "FramePipeline.h"
+#include "ModelInterpreter.h"
+
+struct rpz_context
+{
+	ModelInterpreter interpreter;
+	std::unique_ptr<FramePipeline> pipeline;
+	std::unique_ptr<CameraHandler> camera;
+	unsigned queue_depth;
+	bool started = false;
+
+	std::mutex mutex; // protects everything below
+	std::condition_variable results_ready;
+	std::deque<rpz_result> results;
+	std::shared_ptr<const CameraFrame> latest_frame;
+	rpz_frame_callback frame_callback = nullptr;
+	void *frame_callback_data = nullptr;
+
+	void onFrame (const CameraFrame &frame);
+};
+
+// What rpz_frame::priv points at: a reference to the frame, either owned by the application (from
+// rpz_acquire_latest_frame() and rpz_frame_retain(), to release) or borrowed for a callback
+struct FrameReference
+{
+	std::shared_ptr<const CameraFrame> frame;
+	bool owned;
+};
+
+static rpz_frame describeFrame (const std::shared_ptr<const CameraFrame> &frame, FrameReference *priv)
+{
+	rpz_frame result;
+	result.data     = frame->data.data();
+	result.size     = frame->data.size();
+	result.format   = frame->format == FrameFormat::NV12 ? RPZ_FORMAT_NV12 : RPZ_FORMAT_BGR;
+	result.width    = frame->width;
+	result.height   = frame->height;
+	result.stride   = frame->stride;
+	result.sequence = frame->sequence;
+	result.priv     = priv;
+	return result;
+}
+
+// Capture thread
+void rpz_context::onFrame (const CameraFrame &frame)
+{
+	std::shared_ptr<const CameraFrame> shared = frame.shared_from_this();
+	rpz_frame_callback callback;
+	void *callback_data;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		latest_frame = shared;
+		callback = frame_callback;
+		callback_data = frame_callback_data;
+	}
+	if (callback) {
+		// priv points at a reference that lives as long as the callback, rpz_frame_retain() copies it
+		FrameReference borrowed = {shared, false};
+		rpz_frame view = describeFrame(shared, &borrowed);
+		callback(&view, callback_data);
+	}
+
+	FrameResult frame_result;
+	pipeline->process(frame, frame_result);
+
+	rpz_result result = {};
+	result.sequence = frame.sequence;
+	result.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	result.class_id = frame_result.class_id;
+	result.confidence = frame_result.confidence;
+	result.label = result.class_id >= 0 && result.class_id < (int) interpreter.getClassLabels().size()
+		? interpreter.getClassLabels()[result.class_id].c_str() : "";
+	result.num_classes = std::min<size_t>(frame_result.detections.size(), RPZ_MAX_CLASSES);
+	for (const Detection &detection : frame_result.detections)
+		if (detection.class_id >= 0 && detection.class_id < RPZ_MAX_CLASSES)
+			result.confidences[detection.class_id] = detection.confidence;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (results.size() >= queue_depth) results.pop_front();
+		results.push_back(result);
+	}
+	results_ready.notify_one();
+}
+
+extern "C" {
+
+void rpz_config_init (rpz_config *config)
+{
+	ModelOptions defaults;
+	config->model_file  = nullptr;
+	config->label_file  = nullptr;
+	config->width       = 640;
+	config->height      = 480;
+	config->num_threads = defaults.num_threads;
+	config->lock_memory = 0;
+	config->queue_depth = 8;
+}
+
+int rpz_open (const rpz_config *config, rpz_context **context)
+{
+	if (!config || !context) return -EINVAL;
+	*context = nullptr;
+
+	std::unique_ptr<rpz_context> ctx(new (std::nothrow) rpz_context);
+	if (!ctx) return -ENOMEM;
+	ctx->queue_depth = std::max(1u, config->queue_depth);
+
+	ModelOptions options;
+	if (config->model_file) options.model_file = config->model_file;
+	if (config->label_file) options.label_file = config->label_file;
+	if (config->num_threads > 0) options.num_threads = config->num_threads;
+	options.lock_memory = config->lock_memory;
+	if (config->lock_memory) setMemoryLocking(true);
+	if (!ctx->interpreter.init(options)) return -EIO;
+	ctx->pipeline = std::make_unique<FramePipeline>(ctx->interpreter);
+
+	rpz_context *raw = ctx.get();
+	ctx->camera = std::make_unique<CameraHandler>([raw] (const CameraFrame &frame) { raw->onFrame(frame); });
+	if (!ctx->camera->init(config->width, config->height)) return -ENODEV;
+
+	*context = ctx.release();
+	return 0;
+}
+
+int rpz_start (rpz_context *context)
+{
+	if (!context) return -EINVAL;
+	if (context->started) return 0;
+	if (!context->camera->start()) return -EIO;
+	context->started = true;
+	return 0;
+}
+
+int rpz_stop (rpz_context *context)
+{
+	if (!context) return -EINVAL;
+	if (context->started) context->camera->stop();
+	context->started = false;
+	return 0;
+}
+
+void rpz_close (rpz_context *context)
+{
+	if (!context) return;
+	rpz_stop(context);
+	delete context;
+}
+
+int rpz_poll (rpz_context *context, rpz_result *result, int timeout_ms)
+{
+	if (!context || !result) return -EINVAL;
+	std::unique_lock<std::mutex> lock(context->mutex);
+	auto ready = [context] { return !context->results.empty(); };
+	if (timeout_ms < 0)
+		context->results_ready.wait(lock, ready);
+	else if (!context->results_ready.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready))
+		return 0;
+	*result = context->results.front();
+	context->results.pop_front();
+	return 1;
+}
+
+int rpz_set_frame_callback (rpz_context *context, rpz_frame_callback callback, void *user_data)
+{
+	if (!context) return -EINVAL;
+	std::lock_guard<std::mutex> lock(context->mutex);
+	context->frame_callback = callback;
+	context->frame_callback_data = user_data;
+	return 0;
+}
+
+int rpz_set_roi (rpz_context *context, float x, float y, float width, float height)
+{
+	if (!context || width <= 0 || height <= 0) return -EINVAL;
+	context->camera->setRoi(x, y, width, height);
+	return 0;
+}
+
+int rpz_acquire_latest_frame (rpz_context *context, rpz_frame *frame)
+{
+	if (!context || !frame) return -EINVAL;
+	std::shared_ptr<const CameraFrame> latest;
+	{
+		std::lock_guard<std::mutex> lock(context->mutex);
+		latest = context->latest_frame;
+	}
+	if (!latest) return -EAGAIN;
+	auto *reference = new (std::nothrow) FrameReference{latest, true};
+	if (!reference) return -ENOMEM;
+	*frame = describeFrame(latest, reference);
+	return 0;
+}
+
+int rpz_frame_retain (const rpz_frame *frame, rpz_frame *retained)
+{
+	if (!frame || !retained || !frame->priv) return -EINVAL;
+	const FrameReference &source = *static_cast<const FrameReference*>(frame->priv);
+	auto *reference = new (std::nothrow) FrameReference{source.frame, true};
+	if (!reference) return -ENOMEM;
+	*retained = *frame;
+	retained->priv = reference;
+	return 0;
+}
+
+void rpz_frame_release (rpz_frame *frame)
+{
+	if (!frame || !frame->priv) return;
+	FrameReference *reference = static_cast<FrameReference*>(frame->priv);
+	if (!reference->owned) {
+		std::cerr << "rpz_frame_release: frame " << frame->sequence << " is borrowed from a callback, not released." << std::endl;
+		return;
+	}
+	delete reference;
+	frame->priv = nullptr;
+	frame->data = nullptr;
+}
+
+} // extern "C"
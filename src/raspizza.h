@@ -0,0 +1,100 @@
+#ifndef RASPIZZA_H
+#define RASPIZZA_H
+
+/*
+ * libraspizza: camera capture, preprocessing and pizza classification, embeddable in-process.
+ *
+ *   rpz_config config;
+ *   rpz_config_init(&config);
+ *   rpz_context *ctx;
+ *   if (rpz_open(&config, &ctx) == 0 && rpz_start(ctx) == 0) {
+ *       rpz_result result;
+ *       while (rpz_poll(ctx, &result, 1000) >= 0)
+ *           if (result.class_id >= 0) printf("%s %.2f\n", result.label, result.confidence);
+ *   }
+ *   rpz_close(ctx);
+ *
+ * Functions return 0 (or a positive count) on success and a negative errno value on failure.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RPZ_MAX_CLASSES 16
+
+typedef struct rpz_context rpz_context;
+
+typedef struct rpz_config {
+	const char *model_file;   /* NULL: default model */
+	const char *label_file;   /* NULL: default labels */
+	unsigned    width;        /* camera stream size */
+	unsigned    height;
+	int         num_threads;  /* inference threads */
+	int         lock_memory;  /* non-zero: pre-faulted, mlock'ed buffers and tensor arena */
+	unsigned    queue_depth;  /* results kept for rpz_poll(), the oldest are dropped */
+} rpz_config;
+
+typedef struct rpz_result {
+	uint32_t    sequence;      /* camera frame sequence number */
+	uint64_t    timestamp_ns;  /* CLOCK_MONOTONIC, when the result was produced */
+	int         class_id;      /* most confident class, -1 if the frame couldn't be classified */
+	float       confidence;
+	const char *label;         /* valid until rpz_close() */
+	unsigned    num_classes;
+	float       confidences[RPZ_MAX_CLASSES];
+} rpz_result;
+
+enum rpz_frame_format {
+	RPZ_FORMAT_NV12 = 0,  /* Y plane, then interleaved UV plane, same stride */
+	RPZ_FORMAT_BGR  = 1,
+};
+
+/* Reference to a captured frame, without copy. */
+typedef struct rpz_frame {
+	const uint8_t *data;
+	size_t         size;
+	int            format;   /* enum rpz_frame_format */
+	int            width;
+	int            height;
+	int            stride;
+	uint32_t       sequence;
+	void          *priv;     /* library-owned */
+} rpz_frame;
+
+/* Called on the capture thread for every frame. The frame is borrowed: valid until the callback
+ * returns, and must not be released (nor any copy of it); use rpz_frame_retain() to keep it
+ * longer, and release the retained frame. Keep it short: it delays inference. */
+typedef void (*rpz_frame_callback)(const rpz_frame *frame, void *user_data);
+
+void rpz_config_init (rpz_config *config);
+
+int  rpz_open  (const rpz_config *config, rpz_context **context);
+int  rpz_start (rpz_context *context);
+int  rpz_stop  (rpz_context *context);
+void rpz_close (rpz_context *context);
+
+/* Waits up to timeout_ms (-1: forever) for the next result. Returns 1 with a result, 0 on timeout. */
+int rpz_poll (rpz_context *context, rpz_result *result, int timeout_ms);
+
+int rpz_set_frame_callback (rpz_context *context, rpz_frame_callback callback, void *user_data);
+
+/* Region of interest, normalized to the camera's field of view (0..1): the ISP crops to it and
+ * scales it to the stream size. Widened to the stream aspect ratio; can be moved at any time,
+ * e.g. to follow a tracked object. (0, 0, 1, 1) restores the full field of view. */
+int rpz_set_roi (rpz_context *context, float x, float y, float width, float height);
+
+/* Zero-copy frame access: acquired and retained frames are kept out of the capture pool until
+ * released. Releasing a callback frame is an error, and does nothing. */
+int  rpz_acquire_latest_frame (rpz_context *context, rpz_frame *frame);
+int  rpz_frame_retain  (const rpz_frame *frame, rpz_frame *retained);
+void rpz_frame_release (rpz_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RASPIZZA_H */
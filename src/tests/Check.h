@@ -0,0 +1,29 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+// Minimal checks for the behaviour tests (make test): a failed check is reported with its
+// location, the test goes on, and the program exits with a failure status.
+
+inline int check_failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+			++check_failures; \
+		} \
+	} while (0)
+
+// Exit status of a test program
+inline int checkReport (const char *test)
+{
+	if (check_failures)
+		std::cerr << test << ": " << check_failures << " check(s) failed" << std::endl;
+	else
+		std::cout << test << ": passed" << std::endl;
+	return check_failures ? 1 : 0;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,134 @@
+// Drift monitoring: the sketches of the classifier outputs, their PSI against the reference, the
+// ring of hours and the reference file. Frames are fed as synthetic detections.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "Check.h"
+#include "DriftMonitor.h"
+
+// Two classes: class_id winning with the given confidence, the other one at half of it
+static std::vector<Detection> frame (float confidence, int class_id = 0)
+{
+	return {{class_id, confidence}, {1 - class_id, confidence / 2}};
+}
+
+// Confidences cycling over [0.6, 1): the same distribution every 100 frames
+static float steady (int n)
+{
+	return 0.6f + 0.4f * (n * 37 % 100) / 100;
+}
+
+// Value of key in the JSON object starting at object (e.g. "\"reference\":{"), NaN if missing
+static double number (const std::string &json, const std::string &key, const std::string &object = "")
+{
+	size_t start = object.empty() ? 0 : json.find(object);
+	size_t at = start == std::string::npos ? start : json.find("\"" + key + "\":", start);
+	if (at == std::string::npos) return NAN;
+	return std::strtod(json.c_str() + at + key.size() + 3, nullptr);
+}
+
+static void testPSI ()
+{
+	const std::time_t now = std::time(nullptr);
+	DriftMonitor same("", 300);
+	for (int n = 0; n < 300 + 1200; ++n)
+		same.update(frame(steady(n)), now);
+	CHECK(std::fabs(number(same.toJson(), "confidence_psi")) < 0.01);
+	CHECK(!same.drifted());
+
+	// Less confident after a while: dirty lens
+	DriftMonitor shifted("", 300);
+	for (int n = 0; n < 300; ++n)
+		shifted.update(frame(steady(n)), now);
+	for (int n = 0; n < 1200; ++n)
+		shifted.update(frame(steady(n) - 0.25f), now);
+	CHECK(number(shifted.toJson(), "confidence_psi") > 0.25);
+	CHECK(shifted.drifted());
+}
+
+static void testQuantiles ()
+{
+	// Reference of 150 frames in bin 3 (0.1) and 150 in bin 28 (0.9), interpolated within the bins
+	DriftMonitor monitor("", 300);
+	for (int n = 0; n < 300; ++n)
+		monitor.update(frame(n < 150 ? 0.1f : 0.9f));
+	const std::string json = monitor.toJson();
+	const std::string reference = "\"reference\":{";
+	CHECK(number(json, "frames", reference) == 300);
+	CHECK(std::fabs(number(json, "confidence_p10", reference) - (3 + 30.5 / 150) / 32) < 1e-4);
+	CHECK(std::fabs(number(json, "confidence_p50", reference) - (28 + 0.5 / 150) / 32) < 1e-4);
+	CHECK(std::fabs(number(json, "confidence_p90", reference) - (28 + 120.5 / 150) / 32) < 1e-4);
+}
+
+static void testHourRing ()
+{
+	// A day ago the current hour's slot was filled: coming back around, it starts over
+	const std::time_t now = std::time(nullptr);
+	DriftMonitor monitor("", 300);
+	for (int n = 0; n < 5; ++n)
+		monitor.update(frame(0.9f, 1), now - DriftMonitor::kHours * 3600);
+	for (int n = 0; n < 3; ++n)
+		monitor.update(frame(0.9f, 0), now);
+	const std::string json = monitor.toJson();
+	CHECK(json.find("[3,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]]}") != std::string::npos);
+	CHECK(number(json, "frames", "\"recent\":{") == 3);
+}
+
+static void testReferenceFile ()
+{
+	const std::string path = "/tmp/TestDriftMonitor-" + std::to_string(getpid()) + ".txt";
+	std::remove(path.c_str());
+	std::string captured;
+	{
+		DriftMonitor monitor(path, 300);
+		for (int n = 0; n < 300; ++n)
+			monitor.update(frame(steady(n), n % 2));
+		captured = monitor.toJson();
+	}
+	auto referenceOf = [] (const std::string &json) {
+		const size_t start = json.find("\"reference\":{");
+		return json.substr(start, json.find('}', start) - start);
+	};
+	{
+		DriftMonitor loaded(path, 300);
+		const std::string json = loaded.toJson();
+		CHECK(json.find("\"reference_ready\":true") != std::string::npos);
+		CHECK(referenceOf(json) == referenceOf(captured));
+	}
+
+	// Truncated: rejected, and captured again
+	std::string contents;
+	{
+		std::ifstream file(path);
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	std::ofstream(path) << contents.substr(0, contents.size() / 2);
+	{
+		DriftMonitor corrupted(path, 300);
+		const std::string json = corrupted.toJson();
+		CHECK(json.find("\"reference_ready\":false") != std::string::npos && number(json, "reference_frames") == 0);
+	}
+	std::ofstream(path) << "raspizza-frame-1 nv12 640 480\n";
+	{
+		DriftMonitor other(path, 300);
+		CHECK(other.toJson().find("\"reference_ready\":false") != std::string::npos);
+	}
+	std::remove(path.c_str());
+}
+
+int main ()
+{
+	testPSI();
+	testQuantiles();
+	testHourRing();
+	testReferenceFile();
+	return checkReport("TestDriftMonitor");
+}
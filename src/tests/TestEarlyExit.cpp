@@ -0,0 +1,62 @@
+// Early exit options: the per-class thresholds given on the command line (my_interpreter
+// --exit-thresholds, my_loadgen --early-exit), and their labels checked against the model's.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Check.h"
+#include "EarlyExit.h"
+
+using Thresholds = std::vector<std::pair<std::string, float>>;
+
+static void testParsing ()
+{
+	Thresholds thresholds;
+	CHECK(parseClassThresholds("everything_else=0.8,pizza_shovel=0.97", thresholds));
+	CHECK(thresholds == Thresholds({{"everything_else", 0.8f}, {"pizza_shovel", 0.97f}}));
+	CHECK(parseClassThresholds("raw_pizzas=1", thresholds) && thresholds == Thresholds({{"raw_pizzas", 1.f}}));
+
+	CHECK(!parseClassThresholds("everything_else=0.8,pizza_shovel=high", thresholds)); // not a number
+	CHECK(!parseClassThresholds("everything_else=0.8x", thresholds));
+	CHECK(!parseClassThresholds("everything_else=", thresholds));
+	CHECK(!parseClassThresholds("everything_else,pizza_shovel=0.9", thresholds));      // no =
+	CHECK(!parseClassThresholds("=0.9", thresholds));                                   // no label
+	CHECK(!parseClassThresholds("", thresholds));                                       // empty list
+}
+
+// Runs init() on a model without segments, returning what it reported
+static std::string initErrors (const EarlyExitOptions &options, const std::vector<std::string> &labels)
+{
+	tflite::Interpreter interpreter;
+	EarlyExit early_exit;
+	std::ostringstream errors;
+	std::streambuf *cerr = std::cerr.rdbuf(errors.rdbuf());
+	const bool ok = early_exit.init(interpreter, options, labels, 224, 224, 3, kTfLiteUInt8);
+	std::cerr.rdbuf(cerr);
+	CHECK(!ok);
+	return errors.str();
+}
+
+static void testLabels ()
+{
+	const std::vector<std::string> labels = {"cooked_pizzas", "everything_else", "pizza_shovel", "raw_pizzas"};
+	EarlyExitOptions options;
+	options.enabled = true;
+	options.class_thresholds = {{"everything_else", 0.8f}, {"dough", 0.9f}};
+	CHECK(initErrors(options, labels).find("No class 'dough'") != std::string::npos);
+
+	// Known labels get through, to the (missing) segments
+	options.class_thresholds.pop_back();
+	const std::string errors = initErrors(options, labels);
+	CHECK(errors.find("No class") == std::string::npos && errors.find("segment0") != std::string::npos);
+}
+
+int main ()
+{
+	testParsing();
+	testLabels();
+	return checkReport("TestEarlyExit");
+}
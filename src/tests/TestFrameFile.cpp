@@ -0,0 +1,85 @@
+// Frame files: what my_interpreter --dump-frames writes is what the replay tools read back.
+
+#include <sstream>
+#include <string>
+
+#include "Check.h"
+#include "FrameFile.h"
+
+static void fillFrame (CameraFrame &frame, FrameFormat format, int width, int height, int stride, uint32_t sequence)
+{
+	frame.format = format;
+	frame.width = width;
+	frame.height = height;
+	frame.stride = stride;
+	frame.sequence = sequence;
+	frame.data.resize(size_t(stride) * (format == FrameFormat::NV12 ? height + height / 2 : height));
+	for (size_t i = 0; i < frame.data.size(); ++i)
+		frame.data[i] = uint8_t(i * 7 + sequence);
+}
+
+static bool sameFrame (const CameraFrame &a, const CameraFrame &b)
+{
+	return a.format == b.format && a.width == b.width && a.height == b.height && a.stride == b.stride
+		&& a.sequence == b.sequence && a.data == b.data;
+}
+
+static bool sameRawInfo (const RawInfo &a, const RawInfo &b)
+{
+	return a.order == b.order && a.bit_depth == b.bit_depth && a.black_level == b.black_level
+		&& a.gains[0] == b.gains[0] && a.gains[1] == b.gains[1] && a.gains[2] == b.gains[2];
+}
+
+static void testRoundTrip ()
+{
+	CameraFrame nv12, bgr, bayer;
+	fillFrame(nv12, FrameFormat::NV12, 64, 48, 80, 1); // padded rows
+	fillFrame(bgr, FrameFormat::BGR, 32, 16, 96, 2);
+	fillFrame(bayer, FrameFormat::Bayer10P, 64, 32, 96, 3);
+	bayer.raw.order = BayerOrder::GBRG;
+	bayer.raw.bit_depth = 10;
+	bayer.raw.black_level = 60;
+	bayer.raw.gains[0] = 1.8273456f; // as reported by the ISP, not round numbers
+	bayer.raw.gains[2] = 1.2345679f;
+
+	std::stringstream file;
+	CHECK(writeFrame(file, nv12));
+	CHECK(writeFrame(file, bgr));
+	CHECK(writeFrame(file, bayer));
+
+	CameraFrame frame;
+	CHECK(readFrame(file, frame) && sameFrame(frame, nv12));
+	CHECK(readFrame(file, frame) && sameFrame(frame, bgr));
+	CHECK(readFrame(file, frame) && sameFrame(frame, bayer) && sameRawInfo(frame.raw, bayer.raw));
+	CHECK(!readFrame(file, frame)); // end of the file
+}
+
+static void testInvalidFiles ()
+{
+	CameraFrame frame, read;
+	fillFrame(frame, FrameFormat::NV12, 16, 8, 16, 0);
+	std::stringstream file;
+	writeFrame(file, frame);
+	const std::string bytes = file.str();
+
+	std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+	CHECK(!readFrame(truncated, read));
+
+	std::stringstream other("P6 640 480 255\n");
+	CHECK(!readFrame(other, read));
+
+	std::string unknown_format = bytes;
+	unknown_format.replace(unknown_format.find("nv12"), 4, "yuyv");
+	std::stringstream unknown(unknown_format);
+	CHECK(!readFrame(unknown, read));
+
+	std::stringstream empty;
+	CHECK(!readFrame(empty, read));
+}
+
+int main ()
+{
+	testRoundTrip();
+	testInvalidFiles();
+	return checkReport("TestFrameFile");
+}
@@ -0,0 +1,247 @@
+// Inference scheduling: which job runs next, and which ones are dropped. Jobs "infer" by recording
+// their frame sequence, some of them holding their thread until released.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "InferenceScheduler.h"
+
+using namespace std::chrono_literals;
+
+// What the jobs did, in order
+class Recorder
+{
+public:
+	// Infer function of a lane: records the frame, then waits while it is held
+	InferenceScheduler::Infer lane (int lane)
+	{
+		return [this, lane] (const PreparedInput &input, FrameResult &result) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			ran_.push_back(input.sequence);
+			running_[lane]++;
+			max_running_[lane] = std::max(max_running_[lane], running_[lane]);
+			changed_.notify_all();
+			changed_.wait(lock, [&] { return !held_[lane]; });
+			running_[lane]--;
+			result.class_id = lane;
+			return true;
+		};
+	}
+
+	InferenceScheduler::Callback done ()
+	{
+		return [this] (const FrameResult &, bool ran) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			++(ran ? completed_ : dropped_);
+			changed_.notify_all();
+		};
+	}
+
+	void hold    (int lane) { set(lane, true); }
+	void release (int lane) { set(lane, false); }
+
+	// Waits until count jobs ran (or were dropped), at most a second
+	bool waitRan (size_t count)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return changed_.wait_for(lock, 1s, [&] { return ran_.size() >= count; });
+	}
+	bool waitFinished (int completed, int dropped)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return changed_.wait_for(lock, 1s, [&] { return completed_ >= completed && dropped_ >= dropped; });
+	}
+
+	std::vector<uint32_t> ran () { std::lock_guard<std::mutex> lock(mutex_); return ran_; }
+	int completed () { std::lock_guard<std::mutex> lock(mutex_); return completed_; }
+	int dropped   () { std::lock_guard<std::mutex> lock(mutex_); return dropped_; }
+	int maxRunning (int lane) { std::lock_guard<std::mutex> lock(mutex_); return max_running_[lane]; }
+
+private:
+	std::mutex mutex_;
+	std::condition_variable changed_;
+	std::vector<uint32_t> ran_;
+	bool held_[4] = {};
+	int running_[4] = {}, max_running_[4] = {};
+	int completed_ = 0, dropped_ = 0;
+
+	void set (int lane, bool held)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		held_[lane] = held;
+		changed_.notify_all();
+	}
+};
+
+static PreparedInput frame (uint32_t sequence)
+{
+	PreparedInput input;
+	input.sequence = sequence;
+	return input;
+}
+
+static LaneOptions lane (int priority, std::chrono::milliseconds deadline, size_t max_queued = 8)
+{
+	LaneOptions options;
+	options.priority = priority;
+	options.deadline = deadline;
+	options.max_queued = max_queued;
+	return options;
+}
+
+// Higher priority first, then the earliest deadline
+static void testOrder ()
+{
+	Recorder recorder;
+	InferenceScheduler scheduler(1);
+	const int blocker = scheduler.addLane(recorder.lane(0), lane(0, 10s));
+	const int low     = scheduler.addLane(recorder.lane(1), lane(0, 5s));
+	const int soon    = scheduler.addLane(recorder.lane(2), lane(0, 1s));
+	const int urgent  = scheduler.addLane(recorder.lane(3), lane(1, 5s));
+
+	recorder.hold(0);
+	scheduler.submit(blocker, frame(0), recorder.done());
+	CHECK(recorder.waitRan(1));
+	scheduler.submit(low, frame(10), recorder.done());
+	scheduler.submit(soon, frame(20), recorder.done());
+	scheduler.submit(urgent, frame(30), recorder.done());
+	scheduler.submit(low, frame(11), recorder.done());
+	scheduler.submit(urgent, frame(31), recorder.done());
+	recorder.release(0);
+
+	CHECK(recorder.waitFinished(6, 0));
+	CHECK(recorder.ran() == std::vector<uint32_t>({0, 30, 31, 20, 10, 11}));
+	CHECK(recorder.dropped() == 0);
+}
+
+// A lane runs one job at a time, other lanes run next to it
+static void testLanesConcurrency ()
+{
+	Recorder recorder;
+	InferenceScheduler scheduler(3);
+	const int a = scheduler.addLane(recorder.lane(0), lane(0, 10s));
+	const int b = scheduler.addLane(recorder.lane(1), lane(0, 10s));
+
+	recorder.hold(0);
+	recorder.hold(1);
+	for (uint32_t n = 0; n < 3; ++n) {
+		scheduler.submit(a, frame(n), recorder.done());
+		scheduler.submit(b, frame(10 + n), recorder.done());
+	}
+	CHECK(recorder.waitRan(2)); // one of each lane, on two of the threads
+	std::this_thread::sleep_for(20ms);
+	CHECK(recorder.ran().size() == 2);
+	recorder.release(0);
+	recorder.release(1);
+
+	CHECK(recorder.waitFinished(6, 0));
+	CHECK(recorder.maxRunning(0) == 1 && recorder.maxRunning(1) == 1);
+}
+
+// With several threads, one is kept for the top priority
+static void testReservedThread ()
+{
+	Recorder recorder;
+	InferenceScheduler scheduler(2);
+	const int low_a  = scheduler.addLane(recorder.lane(0), lane(0, 10s));
+	const int low_b  = scheduler.addLane(recorder.lane(1), lane(0, 10s));
+	const int urgent = scheduler.addLane(recorder.lane(2), lane(1, 10s));
+
+	recorder.hold(0);
+	recorder.hold(1);
+	scheduler.submit(low_a, frame(0), recorder.done());
+	scheduler.submit(low_b, frame(1), recorder.done());
+	CHECK(recorder.waitRan(1));
+	std::this_thread::sleep_for(20ms);
+	CHECK(recorder.ran().size() == 1); // the second thread stays free...
+
+	scheduler.submit(urgent, frame(2), recorder.done());
+	CHECK(recorder.waitFinished(1, 0)); // ...and runs the urgent job while the low ones wait
+	CHECK(recorder.ran().size() == 2 && recorder.ran()[1] == 2);
+
+	recorder.release(0);
+	recorder.release(1);
+	CHECK(recorder.waitFinished(3, 0));
+}
+
+// Full queues drop their oldest jobs, expired jobs are dropped unless they are still wanted late
+static void testDropping ()
+{
+	{
+		Recorder recorder;
+		InferenceScheduler scheduler(1);
+		const int blocker = scheduler.addLane(recorder.lane(0), lane(1, 10s));
+		const int queued  = scheduler.addLane(recorder.lane(1), lane(0, 10s, 2));
+		recorder.hold(0);
+		scheduler.submit(blocker, frame(0), recorder.done());
+		CHECK(recorder.waitRan(1));
+		for (uint32_t n = 1; n <= 5; ++n)
+			scheduler.submit(queued, frame(n), recorder.done());
+		CHECK(recorder.dropped() == 3);
+		recorder.release(0);
+		CHECK(recorder.waitFinished(3, 3));
+		CHECK(recorder.ran() == std::vector<uint32_t>({0, 4, 5}));
+	}
+	for (bool drop_expired : {true, false}) {
+		Recorder recorder;
+		InferenceScheduler scheduler(1);
+		const int blocker = scheduler.addLane(recorder.lane(0), lane(1, 10s));
+		LaneOptions options = lane(0, 20ms);
+		options.drop_expired = drop_expired;
+		const int expiring = scheduler.addLane(recorder.lane(1), options);
+		recorder.hold(0);
+		scheduler.submit(blocker, frame(0), recorder.done());
+		CHECK(recorder.waitRan(1));
+		scheduler.submit(expiring, frame(1), recorder.done());
+		std::this_thread::sleep_for(60ms);
+		recorder.release(0);
+		if (drop_expired) {
+			CHECK(recorder.waitFinished(1, 1));
+			CHECK(recorder.ran().size() == 1);
+		} else {
+			CHECK(recorder.waitFinished(2, 0));
+			bool late = false; // counted right after the callback
+			for (int i = 0; i < 100 && !late; ++i, std::this_thread::sleep_for(10ms))
+				late = scheduler.toJson().find("\"late\":1") != std::string::npos;
+			CHECK(late);
+		}
+	}
+}
+
+// Jobs still queued at destruction are dropped, not lost
+static void testShutdown ()
+{
+	Recorder recorder;
+	std::thread release;
+	{
+		InferenceScheduler scheduler(1);
+		const int blocker = scheduler.addLane(recorder.lane(0), lane(1, 10s));
+		const int queued  = scheduler.addLane(recorder.lane(1), lane(0, 10s));
+		recorder.hold(0);
+		scheduler.submit(blocker, frame(0), recorder.done());
+		CHECK(recorder.waitRan(1));
+		scheduler.submit(queued, frame(1), recorder.done());
+		scheduler.submit(queued, frame(2), recorder.done());
+		release = std::thread([&recorder] {
+			std::this_thread::sleep_for(20ms);
+			recorder.release(0);
+		});
+	}
+	release.join();
+	CHECK(recorder.completed() == 1 && recorder.dropped() == 2);
+}
+
+int main ()
+{
+	testOrder();
+	testLanesConcurrency();
+	testReservedThread();
+	testDropping();
+	testShutdown();
+	return checkReport("TestInferenceScheduler");
+}
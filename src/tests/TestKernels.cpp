@@ -0,0 +1,237 @@
+// Image kernels against straightforward floating-point references: the fixed-point (and NEON)
+// versions may round differently, by a level or two, but must compute the same thing.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+#include "Kernels.h"
+
+static std::mt19937 random_engine(1234);
+
+static std::vector<uint8_t> randomBytes (size_t size)
+{
+	std::uniform_int_distribution<int> byte(0, 255);
+	std::vector<uint8_t> bytes(size);
+	for (uint8_t &b : bytes) b = byte(random_engine);
+	return bytes;
+}
+
+// Bilinear sample at destination position d, pixel centers aligned as OpenCV's INTER_LINEAR
+struct Tap
+{
+	int index;
+	double fraction; // weight of index + 1
+};
+
+static Tap tap (int d, int src, int dst)
+{
+	const double position = (d + 0.5) * src / dst - 0.5;
+	if (position <= 0) return {0, 0};
+	if (position >= src - 1) return {std::max(0, src - 2), src > 1 ? 1.0 : 0};
+	const int index = int(std::floor(position));
+	return {index, position - index};
+}
+
+static double sample (const uint8_t *plane, int stride, int step, const Tap &x, const Tap &y, int src_height)
+{
+	const uint8_t *row0 = plane + y.index * stride;
+	const uint8_t *row1 = row0 + (src_height > 1 ? stride : 0);
+	const double top    = row0[x.index * step] * (1 - x.fraction) + row0[(x.index + 1) * step] * x.fraction;
+	const double bottom = row1[x.index * step] * (1 - x.fraction) + row1[(x.index + 1) * step] * x.fraction;
+	return top * (1 - y.fraction) + bottom * y.fraction;
+}
+
+static int maxDifference (const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+	int difference = a.size() == b.size() ? 0 : 256;
+	for (size_t i = 0; i < std::min(a.size(), b.size()); ++i)
+		difference = std::max(difference, std::abs(int(a[i]) - int(b[i])));
+	return difference;
+}
+
+static void testNV12Resize (int src_width, int src_height, int dst_width, int dst_height)
+{
+	const int stride = src_width + 32; // padded rows
+	std::vector<uint8_t> nv12 = randomBytes(size_t(stride) * (src_height + src_height / 2));
+	const uint8_t *y_plane = nv12.data(), *uv_plane = nv12.data() + stride * src_height;
+
+	ResizeMap map;
+	makeResizeMap(map, src_width, src_height, dst_width, dst_height);
+	std::vector<uint8_t> rgb(dst_width * dst_height * 3);
+	nv12ToRGBResize(y_plane, uv_plane, stride, rgb.data(), map);
+
+	// Interpolated Y, U and V, then BT.601 limited range
+	std::vector<uint8_t> reference(rgb.size());
+	for (int dy = 0; dy < dst_height; ++dy) {
+		const Tap ty = tap(dy, src_height, dst_height), tcy = tap(dy, src_height / 2, dst_height);
+		for (int dx = 0; dx < dst_width; ++dx) {
+			const Tap tx = tap(dx, src_width, dst_width), tcx = tap(dx, src_width / 2, dst_width);
+			const double luma = std::max(0.0, sample(y_plane, stride, 1, tx, ty, src_height) - 16);
+			const double u = sample(uv_plane, stride, 2, tcx, tcy, src_height / 2) - 128;
+			const double v = sample(uv_plane + 1, stride, 2, tcx, tcy, src_height / 2) - 128;
+			uint8_t *out = &reference[(dy * dst_width + dx) * 3];
+			out[0] = uint8_t(std::clamp(std::lround(1.164 * luma + 1.596 * v), 0L, 255L));
+			out[1] = uint8_t(std::clamp(std::lround(1.164 * luma - 0.813 * v - 0.391 * u), 0L, 255L));
+			out[2] = uint8_t(std::clamp(std::lround(1.164 * luma + 2.018 * u), 0L, 255L));
+		}
+	}
+	CHECK(maxDifference(rgb, reference) <= 2);
+
+	// Bands of rows, as run on several cores, give the same image
+	std::vector<uint8_t> banded(rgb.size());
+	const int split[] = {0, dst_height / 3, dst_height / 3 + 1, dst_height};
+	for (int band = 0; band < 3; ++band)
+		nv12ToRGBResize(y_plane, uv_plane, stride, banded.data(), map, split[band], split[band + 1]);
+	CHECK(banded == rgb);
+}
+
+static void testPackedResize (int src_width, int src_height, int dst_width, int dst_height)
+{
+	const int stride = src_width * 3 + 5;
+	std::vector<uint8_t> bgr = randomBytes(size_t(stride) * src_height);
+
+	ResizeMap map;
+	makeResizeMap(map, src_width, src_height, dst_width, dst_height);
+	std::vector<uint8_t> rgb(dst_width * dst_height * 3), same(rgb.size());
+	bgrToRGBResize(bgr.data(), stride, rgb.data(), map);
+	rgbResize(bgr.data(), stride, same.data(), map);
+
+	std::vector<uint8_t> reference(rgb.size()), reference_same(rgb.size());
+	for (int dy = 0; dy < dst_height; ++dy) {
+		const Tap ty = tap(dy, src_height, dst_height);
+		for (int dx = 0; dx < dst_width; ++dx) {
+			const Tap tx = tap(dx, src_width, dst_width);
+			for (int c = 0; c < 3; ++c) {
+				const uint8_t value = uint8_t(std::lround(sample(bgr.data() + c, stride, 3, tx, ty, src_height)));
+				reference[(dy * dst_width + dx) * 3 + 2 - c] = value;
+				reference_same[(dy * dst_width + dx) * 3 + c] = value;
+			}
+		}
+	}
+	CHECK(maxDifference(rgb, reference) <= 1);
+	CHECK(maxDifference(same, reference_same) <= 1);
+
+	// At the same size, only the channels move
+	if (src_width == dst_width && src_height == dst_height)
+		CHECK(maxDifference(same, reference_same) == 0);
+}
+
+static void testConversions ()
+{
+	std::vector<uint8_t> bytes = randomBytes(1000);
+	std::vector<float> floats(bytes.size());
+	convertInputU8ToF32(bytes.data(), floats.data(), bytes.size());
+	bool exact = true;
+	for (size_t i = 0; i < bytes.size(); ++i)
+		exact &= floats[i] == bytes[i];
+	CHECK(exact);
+
+	dequantizeU8(bytes.data(), floats.data(), bytes.size(), 0.5f, 128);
+	CHECK(floats[0] == 0.5f * (bytes[0] - 128) && floats[999] == 0.5f * (bytes[999] - 128));
+	const int8_t signed_bytes[] = {-128, 0, 127};
+	float values[3];
+	dequantizeI8(signed_bytes, values, 3, 0.25f, -128);
+	CHECK(values[0] == 0 && values[1] == 32 && values[2] == 63.75f);
+
+	// Wide copies with their tails, at every alignment
+	std::vector<uint8_t> source = randomBytes(300);
+	for (size_t offset : {0, 1, 7}) {
+		for (size_t size : {0, 1, 63, 64, 65, 200, 293}) {
+			std::vector<uint8_t> copy(size + 2, 0xAA);
+			streamCopy(source.data() + offset, copy.data() + 1, size);
+			CHECK(std::equal(copy.begin() + 1, copy.begin() + 1 + size, source.begin() + offset));
+			CHECK(copy.front() == 0xAA && copy.back() == 0xAA);
+		}
+	}
+}
+
+// Raw level of a Bayer pixel, read the obvious way
+static int rawLevel (const uint8_t *raw, FrameFormat format, int stride, int x, int y)
+{
+	const uint8_t *row = raw + y * stride;
+	if (format == FrameFormat::Bayer16)
+		return row[2 * x] | row[2 * x + 1] << 8;
+	const uint8_t *group = row + x / 4 * 5;
+	return group[x % 4] << 2 | (group[4] >> (2 * (x % 4)) & 3);
+}
+
+static void testBayerBinned (FrameFormat format, BayerOrder order, int bin)
+{
+	const int width = 76, height = 16; // 38 or 19 superpixels: vector loops and their tails
+	const int stride = (format == FrameFormat::Bayer16 ? 2 * width : width / 4 * 5) + 12;
+	RawInfo info;
+	info.order = order;
+	info.bit_depth = format == FrameFormat::Bayer16 ? 12 : 10;
+	info.black_level = format == FrameFormat::Bayer16 ? 256 : 64;
+	info.gains[0] = 1.5f;
+	info.gains[2] = 2.f;
+
+	// Random levels, written in the frame's packing
+	std::vector<uint8_t> raw(size_t(stride) * height, 0);
+	std::uniform_int_distribution<int> level(0, (1 << info.bit_depth) - 1);
+	for (int y = 0; y < height; ++y) {
+		uint8_t *row = raw.data() + y * stride;
+		for (int x = 0; x < width; ++x) {
+			const int value = level(random_engine);
+			if (format == FrameFormat::Bayer16) {
+				row[2 * x] = uint8_t(value);
+				row[2 * x + 1] = uint8_t(value >> 8);
+			} else {
+				row[x / 4 * 5 + x % 4] = uint8_t(value >> 2);
+				row[x / 4 * 5 + 4] |= uint8_t((value & 3) << (2 * (x % 4)));
+			}
+		}
+	}
+
+	RawToneMap map;
+	makeRawToneMap(map, info);
+	const int out_width = width / bin, out_height = height / bin;
+	std::vector<uint8_t> rgb(out_width * out_height * 3);
+	bayerToRGBBinned(raw.data(), format, width, stride, bin, map, rgb.data(), 0, out_height);
+
+	// Mean of the same-color sites of each superpixel: red and blue truncated, green rounded
+	static const char *const patterns[] = {"RGGB", "GRBG", "GBRG", "BGGR"};
+	const char *pattern = patterns[int(order)];
+	std::vector<uint8_t> reference(rgb.size());
+	for (int oy = 0; oy < out_height; ++oy) {
+		for (int ox = 0; ox < out_width; ++ox) {
+			int sum_r = 0, sum_g = 0, sum_b = 0;
+			for (int y = oy * bin; y < (oy + 1) * bin; ++y)
+				for (int x = ox * bin; x < (ox + 1) * bin; ++x) {
+					const int value = rawLevel(raw.data(), format, stride, x, y);
+					const char color = pattern[(y & 1) * 2 + (x & 1)];
+					(color == 'R' ? sum_r : color == 'G' ? sum_g : sum_b) += value;
+				}
+			const int sites = bin * bin / 4;
+			uint8_t *out = &reference[(oy * out_width + ox) * 3];
+			out[0] = map.lut[0][sum_r / sites];
+			out[1] = map.lut[1][(sum_g + sites) / (2 * sites)];
+			out[2] = map.lut[2][sum_b / sites];
+		}
+	}
+	CHECK(rgb == reference);
+
+	// The tone map: black level to 0, white (once balanced) to 255, increasing in between
+	CHECK(map.lut[0][info.black_level] == 0 && map.lut[1].back() == 255);
+	CHECK(std::is_sorted(map.lut[2].begin(), map.lut[2].end()));
+}
+
+int main ()
+{
+	testNV12Resize(640, 480, 224, 224); // downscale
+	testNV12Resize(100, 60, 224, 224);  // upscale
+	testNV12Resize(224, 224, 224, 224);
+	testPackedResize(640, 480, 224, 224);
+	testPackedResize(50, 30, 96, 96);
+	testPackedResize(96, 96, 96, 96);
+	testConversions();
+	for (FrameFormat format : {FrameFormat::Bayer16, FrameFormat::Bayer10P})
+		for (BayerOrder order : {BayerOrder::RGGB, BayerOrder::GRBG, BayerOrder::GBRG, BayerOrder::BGGR})
+			for (int bin : {2, 4})
+				testBayerBinned(format, order, bin);
+	return checkReport("TestKernels");
+}
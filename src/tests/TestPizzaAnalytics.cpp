@@ -0,0 +1,122 @@
+// Oven workflow analytics: the debounced scene state, what it counts, and the sampling rate it
+// asks for. Time is simulated, frames are classifications fed at chosen instants.
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "PizzaAnalytics.h"
+
+using Clock = PizzaAnalytics::Clock;
+using namespace std::chrono_literals;
+
+enum { Cooked, Empty, Shovel, Raw, Other };
+static const std::vector<std::string> labels = {"cooked_pizzas", "everything_else", "pizza_shovel", "raw_pizzas", "dough"};
+
+// frames classifications of class_id, 100 ms apart from t; returns the time of the last one
+static Clock::time_point feed (PizzaAnalytics &analytics, int class_id, int frames, Clock::time_point t, float confidence = 0.9f)
+{
+	for (int i = 0; i < frames; ++i)
+		analytics.update(class_id, confidence, t + i * 100ms);
+	return t + (frames - 1) * 100ms;
+}
+
+static bool has (const PizzaAnalytics &analytics, const std::string &json)
+{
+	return analytics.toJson().find(json) != std::string::npos;
+}
+
+// Sampling interval in force at t, in ms: how long after a frame sampled at t the next one is
+static long interval (PizzaAnalytics &analytics, Clock::time_point t)
+{
+	if (!analytics.shouldSample(t)) return -1;
+	for (long ms = 1; ms <= 2000; ++ms)
+		if (analytics.shouldSample(t + std::chrono::milliseconds(ms))) return ms;
+	return -1;
+}
+
+static void testDebouncing ()
+{
+	const Clock::time_point t = Clock::now();
+	PizzaAnalytics analytics(labels, 3);
+	feed(analytics, Empty, 2, t);
+	CHECK(has(analytics, "\"state\":\"unknown\""));
+	feed(analytics, Empty, 1, t + 1s);
+	CHECK(has(analytics, "\"state\":\"everything_else\""));
+
+	// Interrupted, unconfident or unknown frames don't change the state
+	feed(analytics, Raw, 2, t + 2s);
+	feed(analytics, Empty, 1, t + 3s);
+	feed(analytics, Raw, 2, t + 4s);
+	feed(analytics, Raw, 5, t + 5s, 0.3f);
+	feed(analytics, Other, 5, t + 6s);
+	CHECK(has(analytics, "\"state\":\"everything_else\"") && has(analytics, "\"pizzas_loaded\":0"));
+	CHECK(has(analytics, "\"frames\":18"));
+
+	feed(analytics, Raw, 1, t + 7s); // third in a row, the unknown ones didn't break the streak
+	CHECK(has(analytics, "\"state\":\"raw_pizzas\"") && has(analytics, "\"pizzas_loaded\":1"));
+
+	// Cooked right after raw is the same pizza changing looks, not an unload
+	feed(analytics, Cooked, 3, t + 8s);
+	CHECK(has(analytics, "\"pizzas_unloaded\":0") && has(analytics, "\"pizzas_in_oven\":1"));
+	feed(analytics, Shovel, 3, t + 60s);
+	feed(analytics, Cooked, 3, t + 70s);
+	CHECK(has(analytics, "\"pizzas_unloaded\":1") && has(analytics, "\"pizzas_in_oven\":0"));
+	CHECK(has(analytics, "\"bake_s\":{\"count\":1,\"last\":63"));
+}
+
+static void testSampling ()
+{
+	const Clock::time_point t = Clock::now();
+	PizzaAnalytics analytics(labels, 3);
+	CHECK(interval(analytics, t) == 1); // starting: every frame
+
+	feed(analytics, Empty, 3, t + 10s);
+	CHECK(interval(analytics, t + 20s) == 200); // waiting for a pizza
+	feed(analytics, Raw, 1, t + 30s);
+	CHECK(interval(analytics, t + 31s) == 1); // changing
+	const Clock::time_point loaded = feed(analytics, Raw, 2, t + 32s);
+	CHECK(interval(analytics, t + 33s) == 1); // loading
+
+	feed(analytics, Empty, 3, t + 40s);
+	CHECK(interval(analytics, loaded + 20s) == 1000); // baking
+	CHECK(interval(analytics, loaded + 75s) == 1);    // past 80% of the 90 s expected bake
+	CHECK(interval(analytics, loaded + 200s) == 200); // overdue, its unload was missed
+	feed(analytics, Shovel, 1, loaded + 201s);
+	CHECK(interval(analytics, loaded + 202s) == 1); // something changed
+	feed(analytics, Shovel, 2, loaded + 203s);
+	CHECK(interval(analytics, loaded + 204s) == 1); // shovel
+	feed(analytics, Cooked, 3, loaded + 205s);
+
+	// Three 60 s bakes: then sampling speeds up from 80% of the shortest measured one
+	Clock::time_point now = loaded + 300s;
+	for (int pizza = 0; pizza < 4; ++pizza) {
+		const Clock::time_point in = feed(analytics, Raw, 3, now);
+		feed(analytics, Empty, 3, in + 5s);
+		if (pizza == 3) {
+			CHECK(interval(analytics, in + 40s) == 1000);
+			CHECK(interval(analytics, in + 50s) == 1);
+		}
+		feed(analytics, Shovel, 3, in + 55s);
+		feed(analytics, Cooked, 3, in + 60s - 200ms); // unloaded at 60 s
+		now = in + 100s;
+	}
+	CHECK(has(analytics, "\"bake_s\":{\"count\":5"));
+	CHECK(has(analytics, "\"min\":60,"));
+
+	SamplingOptions fixed;
+	fixed.adaptive = false;
+	PizzaAnalytics every_frame(labels, 3, fixed);
+	const Clock::time_point in = feed(every_frame, Raw, 3, t);
+	feed(every_frame, Empty, 3, in + 5s);
+	CHECK(interval(every_frame, in + 20s) == 1);
+	CHECK(has(every_frame, "\"reason\":\"fixed\""));
+}
+
+int main ()
+{
+	testDebouncing();
+	testSampling();
+	return checkReport("TestPizzaAnalytics");
+}